@@ -94,8 +94,8 @@ function csvprint0() {
 #------------------------------------------------------------------
 
 function csvfield(name, missing) {
-    if (name in _csv_label) {
-        return $_csv_label[name]
+    if (name in CSVHEADER) {
+        return $CSVHEADER[name]
     } else {
         return missing
     }
@@ -112,7 +112,8 @@ BEGINFILE {
         _csv_save_fs = FS
         _csv_save_ofs = OFS
         FS = OFS = CSVFS
-        delete _csv_label
+        _csv_header = (CSVMODE == 2)
+        if (!_csv_header) delete CSVHEADER
     } else {
         _csv_mode = 0
     }
@@ -125,7 +126,7 @@ ENDFILE {
     }
 }
 
-# Record header labels
-_csv_mode  && FNR==1 {
-    for (k=1; k<=NF; k++) _csv_label[$k] = k
+# Record header labels, unless the extension already did (CSVMODE=2)
+_csv_mode && !_csv_header && FNR==1 {
+    for (k=1; k<=NF; k++) CSVHEADER[$k] = k
 }
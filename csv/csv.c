@@ -13,15 +13,27 @@
  */
 
 #include "common.h"
+#include <limits.h>
 #include "csv_convert.h"
 #include "csv_split.h"
 #include "csv_input.h"
+#include "csv_threads.h"
+#include "csv_index.h"
+#include "csv_output.h"
 #include "strbuf.h"
 
 /*-------------------------------------------------------------*\
  *                     BUILT-IN FUNCTIONS
 \*-------------------------------------------------------------*/
  
+/*  to_count --- a number as a positive long, 0 if out of range, inf or nan */
+
+static long
+to_count(double d)
+{
+    return (d >= 1 && d < (double) LONG_MAX) ? (long) d : 0;
+}
+
 /*  Get a single char argument */
 
 static char
@@ -43,6 +55,18 @@ get_char_argument(int k, int nargs, char defval, const char* funcname, awk_bool_
     return defval;
 }
 
+/*  Get a quote char argument. An empty string means no quotes */
+
+static char
+get_quote_argument(int k, int nargs, const char* funcname, awk_bool_t *warned)
+{
+    awk_value_t arg;
+
+    if (nargs > k && get_argument(k, AWK_STRING, & arg) && arg.str_value.len == 0)
+        return '\0';
+    return get_char_argument(k, nargs, '"', funcname, warned);
+}
+
 /*  do_csvconvert --- convert a csv record to a plain text record with fixed field separators */
 
 static awk_value_t *
@@ -72,7 +96,7 @@ do_csvconvert(int nargs, awk_value_t *result API_FINFO_ARG)
         }
     }
     csvcomma = get_char_argument(2, nargs, ',', "csvconvert", &warned);
-    csvquote = get_char_argument(3, nargs, '"', "csvconvert", &warned);
+    csvquote = get_quote_argument(3, nargs, "csvconvert", &warned);
 
     strbuf_p record = csv_convert_record(csv_record.str_value.str, csvfs, csvcomma, csvquote, '\0');
     return make_const_string(strbuf_value(record), record->length, result);
@@ -101,13 +125,75 @@ do_csvsplit(int nargs, awk_value_t *result API_FINFO_ARG)
         fatal(ext_id, _("%s: argument %d must be an array"), "csvsplit", 2);
     }
     csvcomma = get_char_argument(2, nargs, ',', "csvsplit", &warned);
-    csvquote = get_char_argument(3, nargs, '"', "csvsplit", &warned);
+    csvquote = get_quote_argument(3, nargs, "csvsplit", &warned);
 
     clear_array(fields.array_cookie);
     int nfields = csv_split_record(csv_record.str_value.str, fields.array_cookie, csvcomma, csvquote, '\0');
     return make_number(nfields, result);
 }
 
+/*  do_csvsplit_many --- split an array of csv records into an array of arrays of fields */
+
+static awk_value_t *
+do_csvsplit_many(int nargs, awk_value_t *result API_FINFO_ARG)
+{
+    awk_value_t records;
+    awk_value_t out;
+    awk_value_t fields;
+    awk_flat_array_t *flat;
+    size_t k, count;
+    char csvcomma;
+    char csvquote;
+    static awk_bool_t warned = awk_false;
+
+    CHECK_NARGS("csvsplit_many", 4, 2)
+    if (!get_argument(0, AWK_ARRAY, & records)) {
+        fatal(ext_id, _("%s: argument %d must be an array"), "csvsplit_many", 1);
+    }
+    if (!get_argument(1, AWK_ARRAY, & out)) {
+        fatal(ext_id, _("%s: argument %d must be an array"), "csvsplit_many", 2);
+    }
+    if (records.array_cookie == out.array_cookie) {
+        fatal(ext_id, _("%s: arguments %d and %d must be different arrays"), "csvsplit_many", 1, 2);
+    }
+    csvcomma = get_char_argument(2, nargs, ',', "csvsplit_many", &warned);
+    csvquote = get_quote_argument(3, nargs, "csvsplit_many", &warned);
+
+    clear_array(out.array_cookie);
+    /* N.B. flatten_array fails for empty arrays */
+#if gawk_api_major_version >= 2
+    if (!flatten_array_typed(records.array_cookie, &flat, AWK_STRING, AWK_STRING)) {
+#else
+    if (!flatten_array(records.array_cookie, &flat)) {
+#endif
+        return make_number(0, result);
+    }
+    count = 0;
+    for (k = 0; k < flat->count; k++) {
+        awk_element_t *el = &(*flat).elements[k];
+        if (el->value.val_type != AWK_STRING) {
+            if (do_lint && !warned) {
+                lintwarn(ext_id, _("%s: element `%s' is not a string"), "csvsplit_many", el->index.str_value.str);
+                warned = awk_true;
+            }
+            continue;
+        }
+        /* out[index] = new array; set_array_element() keeps its cookie */
+        fields.val_type = AWK_ARRAY;
+        fields.array_cookie = create_array();
+        if (!set_array_element(out.array_cookie, &el->index, &fields)) {
+            if (do_lint) {
+                lintwarn(ext_id, _("%s: set_array_element failed"), "csvsplit_many");
+            }
+            continue;
+        }
+        (void) csv_split_record(el->value.str_value.str, fields.array_cookie, csvcomma, csvquote, '\0');
+        ++count;
+    }
+    release_flattened_array(records.array_cookie, flat);
+    return make_number(count, result);
+}
+
 
 /*-------------------------------------------------------------*\
  *                     INTERFACE VARIABLES
@@ -149,10 +235,33 @@ static VARNODE CSVMODE = {"CSVMODE", 2, "", 0, 0, NULL};
 static VARNODE CSVCOMMA = {"CSVCOMMA", 1, ",", 1, 0, NULL};
 static VARNODE CSVQUOTE = {"CSVQUOTE", 1, "\"", 1, 0, NULL};
 static VARNODE CSVFS = {"CSVFS", 1, "\0", 1, 0, NULL};
+static VARNODE CSVTHREADS = {"CSVTHREADS", 2, "", 0, 0, NULL};
+static VARNODE CSVCOLUMNS = {"CSVCOLUMNS", 1, "", 0, 0, NULL};
+static VARNODE CSVOUTMODE = {"CSVOUTMODE", 2, "", 0, 0, NULL};
+static VARNODE CSVINDEX = {"CSVINDEX", 1, "", 0, 0, NULL};
+static VARNODE CSVINDEXSTEP = {"CSVINDEXSTEP", 2, "", 0, CSV_INDEX_STEP, NULL};
+static VARNODE CSVTIMING = {"CSVTIMING", 2, "", 0, 0, NULL};
 
 /* Set by csv_get_record: */
 static VARNODE CSVRECORD = {"CSVRECORD", 0, "", 0, 0, NULL};
 
+/* Set by csv_take_control_of, if CSVMODE is 2: column numbers by name */
+static awk_array_t CSVHEADER;
+
+/*  csv_varinit_array --- create a reserved array variable */
+
+static awk_array_t
+csv_varinit_array(const char *name)
+{
+    awk_value_t val;
+
+    val.val_type = AWK_ARRAY;
+    val.array_cookie = create_array();
+    if (!sym_update(name, &val))
+        fatal(ext_id, _("CSV reserved array variable `%s' already used with incompatible type."), name);
+    return val.array_cookie;    /* the one installed by sym_update */
+}
+
 static void
 csv_load_vars(void)
 {
@@ -160,7 +269,14 @@ csv_load_vars(void)
     csv_varinit_scalar(&CSVCOMMA, 0);
     csv_varinit_scalar(&CSVQUOTE, 0);
     csv_varinit_scalar(&CSVFS, 0);
+    csv_varinit_scalar(&CSVTHREADS, 0);
+    csv_varinit_scalar(&CSVCOLUMNS, 0);
+    csv_varinit_scalar(&CSVOUTMODE, 0);
+    csv_varinit_scalar(&CSVINDEX, 0);
+    csv_varinit_scalar(&CSVINDEXSTEP, 0);
+    csv_varinit_scalar(&CSVTIMING, 0);
     csv_varinit_scalar(&CSVRECORD, 1);
+    CSVHEADER = csv_varinit_array("CSVHEADER");
 }
 
 /* Cached values of control variables */
@@ -169,6 +285,23 @@ static awk_value_t csvmode;
 static awk_value_t csvcomma;
 static awk_value_t csvquote;
 static awk_value_t csvfs;
+static awk_value_t csvthreads;
+static awk_value_t csvcolumns;
+static awk_value_t csvindex;
+static awk_value_t csvindexstep;
+static awk_value_t csvtiming;
+
+/* Open CSV input files, for csvseek() and csvstats() */
+
+typedef struct csv_input_file {
+    awk_input_buf_t *iobuf;
+    struct csv_input_file *next;
+} csv_input_file_t;
+
+static csv_input_file_t *csv_input_files = NULL;
+
+/* Counters of the closed CSV input files */
+static csv_stats_t csv_closed_stats;
 
 
 /*-------------------------------------------------------------*\
@@ -194,15 +327,13 @@ csv_get_record(char **out,  /* output: pointer to pointer to data */
 
     len = csv_read(cr);
     if (len>=0) {
-        *out = strbuf_value(&(*cr).awk_record);
+        *out = cr->awk_out;
         *errcode = 0;
         *rt_start = cr->rt;
         *rt_len = cr->rt_len;
         {
-            char *csv_rec = strbuf_value(&(*cr).csv_record);
-            int csv_len = strbuf_length(&(*cr).csv_record);
             awk_value_t rec;
-            sym_update_scalar(CSVRECORD.cookie, make_const_string(csv_rec, csv_len, &rec));
+            sym_update_scalar(CSVRECORD.cookie, make_const_string(cr->csv_out, cr->csv_out_len, &rec));
         }
 #if gawk_api_major_version >= 2
         *field_width = cr->csv_fields;
@@ -218,7 +349,19 @@ csv_get_record(char **out,  /* output: pointer to pointer to data */
 
 static void
 csv_close(awk_input_buf_t *iobuf) {
-    csv_reader_close(iobuf->opaque);
+    csv_reader_p cr = iobuf->opaque;
+    csv_input_file_t **p;
+
+    for (p = &csv_input_files; *p; p = &(*p)->next) {
+        if ((*p)->iobuf == iobuf) {
+            csv_input_file_t *node = *p;
+            *p = node->next;
+            gawk_free(node);
+            break;
+        }
+    }
+    csv_stats_add(&csv_closed_stats, &(*cr).stats);
+    csv_reader_close(cr);
 }
 
 /*  BEGINFILE negotiation */
@@ -231,9 +374,62 @@ csv_can_take_file(const awk_input_buf_t *iobuf)
     ret = ret && sym_lookup_scalar(CSVCOMMA.cookie, AWK_STRING, &csvcomma);
     ret = ret && sym_lookup_scalar(CSVQUOTE.cookie, AWK_STRING, &csvquote);
     ret = ret && sym_lookup_scalar(CSVFS.cookie, AWK_STRING, &csvfs);
+    ret = ret && sym_lookup_scalar(CSVTHREADS.cookie, AWK_NUMBER, &csvthreads);
+    ret = ret && sym_lookup_scalar(CSVCOLUMNS.cookie, AWK_STRING, &csvcolumns);
+    ret = ret && sym_lookup_scalar(CSVINDEX.cookie, AWK_STRING, &csvindex);
+    ret = ret && sym_lookup_scalar(CSVINDEXSTEP.cookie, AWK_NUMBER, &csvindexstep);
+    ret = ret && sym_lookup_scalar(CSVTIMING.cookie, AWK_NUMBER, &csvtiming);
     return ret && ((int)(csvmode.num_value) != 0);
 }
 
+/*  set_header --- set CSVHEADER[name] = column */
+
+static void
+set_header(const char *name, size_t len, int column)
+{
+    awk_value_t index;
+    awk_value_t value;
+
+    if (!set_array_element(CSVHEADER, make_const_string(name, len, &index), make_number(column, &value))
+        && do_lint)
+        lintwarn(ext_id, _("%s: set_array_element failed"), "CSVHEADER");
+}
+
+/*  load_header --- read the header record of a file into CSVHEADER.
+ *  The columns are numbered as the fields of $0, after CSVCOLUMNS */
+
+static void
+load_header(csv_reader_p cr)
+{
+    const char *s;
+    int len;
+    int k;
+
+    clear_array(CSVHEADER);
+    if ((len = csv_reader_header(cr)) < 0) return;
+    s = cr->awk_out;
+#if gawk_api_major_version >= 2
+    for (k = 0; k < (int) cr->csv_fields->nf; k++) {
+        s += cr->csv_fields->fields[k].skip;
+        set_header(s, cr->csv_fields->fields[k].len, k + 1);
+        s += cr->csv_fields->fields[k].len;
+    }
+#else
+    {
+        const char *end = s + len;
+        const char *q;
+        for (k = 1; ; k++) {
+            for (q = s; q + cr->csv_fs_len <= end && memcmp(q, cr->csv_fs, cr->csv_fs_len) != 0; q++)
+                ;
+            if (q + cr->csv_fs_len > end) q = end;
+            set_header(s, q - s, k);
+            if (q == end) break;
+            s = q + cr->csv_fs_len;
+        }
+    }
+#endif
+}
+
 /*
  * csv_take_control_of --- set up input parser.
  * We can assume that csv_can_take_file just returned true,
@@ -244,7 +440,9 @@ csv_take_control_of(awk_input_buf_t *iobuf)
 {
     static int warned = FALSE;
     csv_reader_p csv_rdr;
+    csv_input_file_t *node;
     awk_value_t val;
+    int mapped;
 
     if (do_lint && !warned) {
         warned = TRUE;
@@ -257,6 +455,39 @@ csv_take_control_of(awk_input_buf_t *iobuf)
                     csvcomma.str_value.str[0], csvquote.str_value.str[0],
                     csvfs.str_value.str, csvfs.str_value.len);
     iobuf->opaque = csv_rdr;
+    csv_rdr->timing = ((int)(csvtiming.num_value) != 0);
+
+    /* Only some columns, if requested */
+    if (csvcolumns.str_value.len > 0
+        && !csv_reader_columns(csv_rdr, csvcolumns.str_value.str))
+        warning(ext_id, _("CSVCOLUMNS: invalid column list `%s', ignored"), csvcolumns.str_value.str);
+
+    /* Compressed files are decompressed on the fly.
+     * Other regular files are read in place, through a memory mapping */
+    mapped = !csv_reader_decompress(csv_rdr)
+             && S_ISREG(iobuf->sbuf.st_mode)
+             && csv_reader_map(csv_rdr, iobuf->sbuf.st_size);
+
+    /* Record offset index, if requested */
+    if (csvindex.str_value.len > 0
+        && !csv_reader_index(csv_rdr, csvindex.str_value.str, to_count(csvindexstep.num_value)))
+        warning(ext_id, _("CSVINDEX: cannot index `%s' in `%s'"), iobuf->name, csvindex.str_value.str);
+
+    /* The header record goes to CSVHEADER, not to awk */
+    if ((int)(csvmode.num_value) == 2)
+        load_header(csv_rdr);
+
+    /* The threads parse the mapped file after the header.
+     * Clamp the number before converting it: a huge value would overflow */
+    if (mapped && csvthreads.num_value >= 2 && csvindex.str_value.len == 0)
+        (void) csv_reader_threads(csv_rdr, (csvthreads.num_value < CSV_MAX_THREADS
+                                            ? (int)(csvthreads.num_value) : CSV_MAX_THREADS));
+
+    /* Remember the file, for csvseek() and csvstats() */
+    emalloc(node, csv_input_file_t *, sizeof(*node), "csv_take_control_of");
+    node->iobuf = iobuf;
+    node->next = csv_input_files;
+    csv_input_files = node;
 
     /* Set interface methods. */
     iobuf->get_record = csv_get_record;
@@ -268,6 +499,202 @@ csv_take_control_of(awk_input_buf_t *iobuf)
     return awk_true;
 }
 
+/*  find_input_file --- the reader of the open CSV input file named by argument k,
+ *  or FILENAME if not given. NULL if there is none */
+
+static csv_reader_p
+find_input_file(int k, int nargs, const char *funcname)
+{
+    awk_value_t file;
+    csv_input_file_t *node;
+
+    if (nargs > k ? !get_argument(k, AWK_STRING, & file)
+                  : !sym_lookup("FILENAME", AWK_STRING, & file)) {
+        fatal(ext_id, _("%s: argument %d must be a string"), funcname, k+1);
+    }
+    for (node = csv_input_files; node; node = node->next) {
+        if (strcmp(node->iobuf->name, file.str_value.str) == 0)
+            return node->iobuf->opaque;
+    }
+    return NULL;
+}
+
+/*  do_csvseek --- go to a record of an indexed input file, FILENAME by default */
+
+static awk_value_t *
+do_csvseek(int nargs, awk_value_t *result API_FINFO_ARG)
+{
+    awk_value_t record;
+    csv_reader_p cr;
+
+    CHECK_NARGS("csvseek", 2, 1)
+    if (!get_argument(0, AWK_NUMBER, & record)) {
+        fatal(ext_id, _("%s: argument %d must be a number"), "csvseek", 1);
+    }
+    if ((cr = find_input_file(1, nargs, "csvseek")) == NULL || cr->index == NULL) {
+        update_ERRNO_string(_("csvseek: no CSVINDEX for this file"));
+        return make_number(0, result);
+    }
+    /* csv_reader_seek() returns 0 for 0, as for a record out of range */
+    return make_number(csv_reader_seek(cr, to_count(record.num_value)), result);
+}
+
+/*  set_stat --- set array[name] = value */
+
+static void
+set_stat(awk_array_t array, const char *name, double value)
+{
+    awk_value_t index;
+    awk_value_t val;
+
+    if (!set_array_element(array, make_const_string(name, strlen(name), &index), make_number(value, &val))
+        && do_lint)
+        lintwarn(ext_id, _("%s: set_array_element failed"), "csvstats");
+}
+
+/*  do_csvstats --- get the input counters of an open CSV input file,
+ *  or the totals of all CSV input files if no file is given */
+
+static awk_value_t *
+do_csvstats(int nargs, awk_value_t *result API_FINFO_ARG)
+{
+    awk_value_t array;
+    csv_stats_t stats;
+    csv_input_file_t *node;
+
+    CHECK_NARGS("csvstats", 2, 1)
+    if (!get_argument(0, AWK_ARRAY, & array)) {
+        fatal(ext_id, _("%s: argument %d must be an array"), "csvstats", 1);
+    }
+    if (nargs > 1) {
+        csv_reader_p cr = find_input_file(1, nargs, "csvstats");
+        if (cr == NULL) {
+            update_ERRNO_string(_("csvstats: not an open CSV input file"));
+            return make_number(0, result);
+        }
+        stats = cr->stats;
+    } else {
+        stats = csv_closed_stats;
+        for (node = csv_input_files; node; node = node->next)
+            csv_stats_add(&stats, &((csv_reader_p) node->iobuf->opaque)->stats);
+    }
+
+    clear_array(array.array_cookie);
+    set_stat(array.array_cookie, "bytes", (double) stats.bytes);
+    set_stat(array.array_cookie, "records", (double) stats.records);
+    set_stat(array.array_cookie, "fields", (double) stats.fields);
+    set_stat(array.array_cookie, "quoted", (double) stats.quoted);
+    set_stat(array.array_cookie, "errors", (double) stats.errors);
+    set_stat(array.array_cookie, "refills", (double) stats.refills);
+    set_stat(array.array_cookie, "read_time", stats.read_time);
+    set_stat(array.array_cookie, "parse_time", stats.parse_time);
+    return make_number(1, result);
+}
+
+
+/*-------------------------------------------------------------*\
+ *                     OUTPUT WRAPPER
+\*-------------------------------------------------------------*/
+
+/*  csv_output_fwrite --- write awk output as CSV records */
+
+static size_t
+csv_output_fwrite(const void *buf, size_t size, size_t count, FILE *fp __UNUSED, void *opaque)
+{
+    size_t len = size * count;
+    return (csv_write(opaque, buf, len) == len) ? count : 0;
+}
+
+/*  csv_output_fflush --- write the complete records and flush the output file */
+
+static int
+csv_output_fflush(FILE *fp, void *opaque)
+{
+    if (!csv_writer_flush(opaque)) return EOF;
+    return fflush(fp);
+}
+
+/*  csv_output_ferror --- check the output file for errors */
+
+static int
+csv_output_ferror(FILE *fp, void *opaque __UNUSED)
+{
+    return ferror(fp);
+}
+
+/*  csv_output_fclose --- write the pending output and close the file */
+
+static int
+csv_output_fclose(FILE *fp, void *opaque)
+{
+    int ret = csv_writer_close(opaque);
+    gawk_free(opaque);
+    if (fclose(fp) != 0) ret = EOF;
+    return ret;
+}
+
+/*
+ * csv_can_take_output --- depends on CSVOUTMODE when the file is opened.
+ * gawk closes a pipe with pclose(), not through gawk_fclose, so the
+ * pending output could not be written nor the writer freed: pipes are
+ * left alone. The standard output and error are files to gawk.
+ */
+static awk_bool_t
+csv_can_take_output(const awk_output_buf_t *outbuf)
+{
+    awk_value_t outmode;
+    struct stat st;
+    int fd = fileno(outbuf->fp);
+
+    if (fd > STDERR_FILENO && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+        return awk_false;
+    return sym_lookup_scalar(CSVOUTMODE.cookie, AWK_NUMBER, &outmode)
+           && ((int)(outmode.num_value) != 0);
+}
+
+/*
+ * csv_take_control_of_output --- set up the output writer.
+ * Fields are separated by OFS, and records by ORS.
+ */
+static awk_bool_t
+csv_take_control_of_output(awk_output_buf_t *outbuf)
+{
+    static int warned = FALSE;
+    csv_writer_p csv_wtr;
+    awk_value_t comma, quote, ofs, ors;
+
+    if (do_lint && !warned) {
+        warned = TRUE;
+        lintwarn(ext_id, _("`CSVOUTMODE' is a gawk extension"));
+    }
+    if (!sym_lookup_scalar(CSVCOMMA.cookie, AWK_STRING, &comma)
+        || !sym_lookup_scalar(CSVQUOTE.cookie, AWK_STRING, &quote)
+        || !sym_lookup("OFS", AWK_STRING, &ofs)
+        || !sym_lookup("ORS", AWK_STRING, &ors))
+        return awk_false;
+
+    /* Create and initialize an output writer */
+    ezalloc(csv_wtr, struct csv_writer *, sizeof(*csv_wtr), "csv_take_control_of_output");
+    csv_writer_init(csv_wtr, outbuf->fp,
+                    comma.str_value.len ? comma.str_value.str[0] : ',',
+                    quote.str_value.len ? quote.str_value.str[0] : '"',
+                    ofs.str_value.str, ofs.str_value.len,
+                    ors.str_value.str, ors.str_value.len);
+    outbuf->opaque = csv_wtr;
+
+    /* One write per record: let a large stdio buffer gather them.
+     * Not for the standard streams, which may have been written to */
+    if (fileno(outbuf->fp) > STDERR_FILENO && !isatty(fileno(outbuf->fp)))
+        (void) setvbuf(outbuf->fp, NULL, _IOFBF, CSV_OUTPUT_BUFSIZE);
+
+    /* Set interface methods. */
+    outbuf->gawk_fwrite = csv_output_fwrite;
+    outbuf->gawk_fflush = csv_output_fflush;
+    outbuf->gawk_ferror = csv_output_ferror;
+    outbuf->gawk_fclose = csv_output_fclose;
+
+    return awk_true;
+}
 
 /*-------------------------------------------------------------*\
  *                     REGISTER THE EXTENSION
@@ -280,9 +707,19 @@ static awk_input_parser_t csv_parser = {
     NULL
 };
 
+static awk_output_wrapper_t csv_output_wrapper = {
+    "csv",
+    csv_can_take_output,
+    csv_take_control_of_output,
+    NULL
+};
+
 static awk_ext_func_t func_table[] = {
     API_FUNC_MAXMIN("csvconvert", do_csvconvert, 4, 1)
     API_FUNC_MAXMIN("csvsplit", do_csvsplit, 4, 2)
+    API_FUNC_MAXMIN("csvsplit_many", do_csvsplit_many, 4, 2)
+    API_FUNC_MAXMIN("csvseek", do_csvseek, 2, 1)
+    API_FUNC_MAXMIN("csvstats", do_csvstats, 2, 1)
 };
 
 static awk_bool_t
@@ -291,6 +728,7 @@ init_my_module(void)
     GAWKEXTLIB_COMMON_INIT
     csv_load_vars();
     register_input_parser(&csv_parser);
+    register_output_wrapper(&csv_output_wrapper);
     return awk_true;
 }
 
@@ -19,37 +19,51 @@
 
 static char* csv_record;    /* pointer to the csv input string */
 static int pos;             /* input offset */
-static struct strbuf sbuf;  /* buffer to build the output */
+static int reclen;          /* length of the csv input string */
+static struct strbuf sbuf;  /* buffer to build the output, kept between calls */
 static int fieldcount = 0;  /* number of completed fields */
 static char* ofs;           /* output field separator */
 
-static unsigned char next_char() {  /* get the next input char */
+static unsigned char next_char(csv_parser_p p __UNUSED) {  /* get the next input char */
     return csv_record[pos++];
 }
 
-static void begin_field() {         /* start a new output field */
+static const unsigned char *peek_chars(csv_parser_p p __UNUSED, size_t *len) {  /* view the pending input chars */
+    *len = reclen - pos;
+    return (const unsigned char *) &csv_record[pos];
+}
+
+static void skip_chars(csv_parser_p p __UNUSED, size_t len) {  /* consume input chars, after peek_chars */
+    pos += len;
+}
+
+static void begin_field(csv_parser_p p __UNUSED) {         /* start a new output field */
     if (fieldcount) strbuf_put_string(&sbuf, ofs);
 }
 
-static void begin_field0() {        /* start a new '\0' delimited output field */
+static void begin_field0(csv_parser_p p __UNUSED) {        /* start a new '\0' delimited output field */
     if (fieldcount) strbuf_put_char(&sbuf, '\0');
 }
 
-static void end_field() {           /* end of the current output field */
+static void end_field(csv_parser_p p __UNUSED) {           /* end of the current output field */
     ++fieldcount;
 }
 
-static void mark_field() {          /* mark the current output field position */
+static void mark_field(csv_parser_p p __UNUSED) {          /* mark the current output field position */
 }
 
-static void backspace_field() {     /* discard data after the current output field mark */
+static void backspace_field(csv_parser_p p __UNUSED) {     /* discard data after the current output field mark */
 }
 
-static void put_char(unsigned char c) { /* append a character to the current output field */
+static void put_char(csv_parser_p p __UNUSED, unsigned char c) { /* append a character to the current output field */
     strbuf_put_char(&sbuf, c);
 }
 
-static void error(const char* msg) { /* report error message */
+static void put_chars(csv_parser_p p __UNUSED, const unsigned char *s, size_t len) { /* append a run of chars to the current output field */
+    strbuf_put_chars(&sbuf, (const char *) s, len);
+}
+
+static void error(csv_parser_p p __UNUSED, const char* msg) { /* report error message */
     const int WIDTH = 65;
     const int TAIL = 10;
     const int DOTS = 3;
@@ -79,11 +93,25 @@ static void error(const char* msg) { /* report error message */
     nonfatal(ext_id, "csvconvert: %s\n  %s\n  %*c", msg, textline, cursor, '^');
 }
 
+/* The parser kernel, calling the functions above directly */
+#define KERNEL_NEXT_CHAR(p)          next_char(p)
+#define KERNEL_BEGIN_FIELD(p)        (*ofs == '\0' ? begin_field0(p) : begin_field(p))
+#define KERNEL_END_FIELD(p)          end_field(p)
+#define KERNEL_PUT_CHAR(p, c)        put_char(p, c)
+#define KERNEL_ERROR(p, msg)         error(p, msg)
+#define KERNEL_HAS_RUNS(p)           1
+#define KERNEL_PEEK_CHARS(p, lenp)   peek_chars(p, lenp)
+#define KERNEL_SKIP_CHARS(p, len)    skip_chars(p, len)
+#define KERNEL_PUT_CHARS(p, s, len)  put_chars(p, s, len)
+
+#include "csv_kernel.h"
+
 /* csv_convert_record --- convert a csv record to a regular awk record
 using the given field separator */
 strbuf_p csv_convert_record(const char* s, const char* fs, char comma, char quote, char options) {
     csv_record = s;
     pos = 0;
+    reclen = strlen(s);
     fieldcount = 0;
     ofs = fs;
 
@@ -102,8 +130,12 @@ strbuf_p csv_convert_record(const char* s, const char* fs, char comma, char quot
     p.backspace_field = &backspace_field;
     p.put_char = &put_char;
     p.error = &error;
+    p.peek_chars = &peek_chars;
+    p.skip_chars = &skip_chars;
+    p.put_chars = &put_chars;
 
-    strbuf_init(&sbuf);
-    csv_parse(&p);
+    if (sbuf.str == NULL) strbuf_init(&sbuf);
+    strbuf_start(&sbuf);
+    csv_parse_kernel(&p);
     return &sbuf;
 }
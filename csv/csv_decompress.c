@@ -0,0 +1,324 @@
+/*
+ * csv_decompress.c - Read gzip or zstd compressed csv files.
+ */
+
+/*
+ * Copyright (C) 2018 the Free Software Foundation, Inc.
+ *
+ * This file is part of gawk-csv, the GAWK extension for handling CSV data.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/*
+ * If threads are available, a helper thread decompresses the input some
+ * blocks ahead of the parser, so that both run at the same time.
+ * The gawk API is not used here.
+ */
+
+#include "common_aux.h"
+#include <errno.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "csv_decompress.h"
+
+#ifdef CSV_USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSV_USE_ZSTD
+#include <zstd.h>
+#endif
+
+#define INPUT_SIZE 65536            /* compressed input block */
+#define BLOCK_SIZE 262144           /* decompressed output block */
+
+struct csv_decoder {
+    int fd;                 /* compressed input file */
+    int format;             /* CSV_GZIP or CSV_ZSTD */
+    unsigned char *in;      /* compressed input buffer */
+    size_t in_pos;          /* next unread byte in the above */
+    size_t in_len;          /* amount of valid data in the above */
+    int in_eof;             /* no more input */
+    int in_frame;           /* inside a compressed stream */
+    int eof;                /* all data decompressed */
+    const char *error;      /* error message, if any */
+    int reported;           /* the error has been returned */
+#ifdef CSV_USE_ZLIB
+    z_stream zs;
+#endif
+#ifdef CSV_USE_ZSTD
+    ZSTD_DStream *zds;
+#endif
+#ifdef HAVE_PTHREAD_H
+    int threaded;           /* a helper thread fills the blocks */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;      /* a block has been filled or released */
+    char *blocks[CSV_DECODER_BLOCKS];
+    size_t lengths[CSV_DECODER_BLOCKS];
+    int head;               /* oldest filled block */
+    int count;              /* number of filled blocks */
+    size_t offset;          /* consumed data in the oldest block */
+    int done;               /* the helper thread has finished */
+    int shutdown;           /* the helper thread must finish */
+#endif
+};
+
+
+/*  refill --- read more compressed input, if needed. Return 0 at EOF */
+static int
+refill(csv_decoder_p d) {
+    ssize_t len;
+
+    if (d->in_pos < d->in_len) return 1;
+    if (d->in_eof) return 0;
+    do {
+        len = read(d->fd, d->in, INPUT_SIZE);
+    } while (len < 0 && errno == EINTR);
+    d->in_pos = 0;
+    d->in_len = (len > 0) ? len : 0;
+    if (len <= 0) {
+        d->in_eof = 1;
+        if (len < 0) d->error = _("error reading compressed input");
+        return 0;
+    }
+    return 1;
+}
+
+/*  decode --- decompress up to size bytes into out.
+ *  Less than size only at the end of data or after an error */
+static size_t
+decode(csv_decoder_p d, char *out, size_t size) {
+    size_t produced = 0;
+
+    while (produced < size && !d->eof && !d->error) {
+        if (!refill(d)) {
+            if (d->in_frame && !d->error) d->error = _("unexpected end of compressed input");
+            d->eof = 1;
+            break;
+        }
+        switch (d->format) {
+#ifdef CSV_USE_ZLIB
+          case CSV_GZIP: {
+            int ret;
+            d->zs.next_in = d->in + d->in_pos;
+            d->zs.avail_in = d->in_len - d->in_pos;
+            d->zs.next_out = (unsigned char *) out + produced;
+            d->zs.avail_out = size - produced;
+            ret = inflate(&d->zs, Z_NO_FLUSH);
+            d->in_pos = d->in_len - d->zs.avail_in;
+            produced = size - d->zs.avail_out;
+            if (ret == Z_STREAM_END) {
+                d->in_frame = 0;
+                inflateReset(&d->zs);   /* maybe another gzip member follows */
+            } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+                d->in_frame = 1;
+            } else {
+                d->error = d->zs.msg ? d->zs.msg : _("invalid compressed input");
+            }
+            break;
+          }
+#endif
+#ifdef CSV_USE_ZSTD
+          case CSV_ZSTD: {
+            ZSTD_inBuffer ib;
+            ZSTD_outBuffer ob;
+            size_t ret;
+            ib.src = d->in;
+            ib.size = d->in_len;
+            ib.pos = d->in_pos;
+            ob.dst = out;
+            ob.size = size;
+            ob.pos = produced;
+            ret = ZSTD_decompressStream(d->zds, &ob, &ib);
+            d->in_pos = ib.pos;
+            produced = ob.pos;
+            if (ZSTD_isError(ret)) {
+                d->error = ZSTD_getErrorName(ret);
+            } else {
+                d->in_frame = (ret != 0);   /* 0 = end of a frame */
+            }
+            break;
+          }
+#endif
+          default:
+            d->error = _("unsupported compressed input");
+            break;
+        }
+    }
+    return produced;
+}
+
+#ifdef HAVE_PTHREAD_H
+/*  helper --- thread body: fill the free blocks */
+static void *
+helper(void *arg) {
+    csv_decoder_p d = arg;
+    int slot;
+    size_t len;
+
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        while (d->count == CSV_DECODER_BLOCKS && !d->shutdown)
+            pthread_cond_wait(&d->cv, &d->lock);
+        if (d->shutdown) break;
+        slot = (d->head + d->count) % CSV_DECODER_BLOCKS;
+        pthread_mutex_unlock(&d->lock);
+
+        len = decode(d, d->blocks[slot], BLOCK_SIZE);
+
+        pthread_mutex_lock(&d->lock);
+        d->lengths[slot] = len;
+        if (len > 0) d->count++;
+        if (d->eof || d->error) d->done = 1;
+        pthread_cond_broadcast(&d->cv);
+        if (d->done) break;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return NULL;
+}
+#endif
+
+
+/*  csv_compression --- guess the compression format from the first bytes */
+int
+csv_compression(const unsigned char *magic, size_t len) {
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return CSV_GZIP;
+    if (len >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return CSV_ZSTD;
+    return CSV_PLAIN;
+}
+
+/*  csv_decoder_open --- decompress fd, after the len bytes already read in pending.
+ *  Return NULL if the format is not supported */
+csv_decoder_p
+csv_decoder_open(int fd, int format, const char *pending, size_t len) {
+    csv_decoder_p d;
+
+    switch (format) {
+#ifdef CSV_USE_ZLIB
+      case CSV_GZIP:
+        break;
+#endif
+#ifdef CSV_USE_ZSTD
+      case CSV_ZSTD:
+        break;
+#endif
+      default:
+        return NULL;
+    }
+
+    ezalloc(d, csv_decoder_p, sizeof(*d), "csv_decoder_open");
+    d->fd = fd;
+    d->format = format;
+    emalloc(d->in, unsigned char *, INPUT_SIZE > len ? INPUT_SIZE : len, "csv_decoder_open");
+    if (len > 0) memcpy(d->in, pending, len);
+    d->in_len = len;
+#ifdef CSV_USE_ZLIB
+    if (format == CSV_GZIP && inflateInit2(&d->zs, 15 + 16) != Z_OK) {
+        gawk_free(d->in);
+        gawk_free(d);
+        return NULL;
+    }
+#endif
+#ifdef CSV_USE_ZSTD
+    if (format == CSV_ZSTD && ((d->zds = ZSTD_createDStream()) == NULL
+                               || ZSTD_isError(ZSTD_initDStream(d->zds)))) {
+        if (d->zds) ZSTD_freeDStream(d->zds);
+        gawk_free(d->in);
+        gawk_free(d);
+        return NULL;
+    }
+#endif
+
+#ifdef HAVE_PTHREAD_H
+    {
+        int k;
+        for (k = 0; k < CSV_DECODER_BLOCKS; k++)
+            emalloc(d->blocks[k], char *, BLOCK_SIZE, "csv_decoder_open");
+        pthread_mutex_init(&d->lock, NULL);
+        pthread_cond_init(&d->cv, NULL);
+        d->threaded = (pthread_create(&d->thread, NULL, helper, d) == 0);
+    }
+#endif
+    return d;
+}
+
+/*  csv_decoder_read --- read decompressed data.
+ *  Return the length, 0 at the end, or -1 once after an error */
+ssize_t
+csv_decoder_read(csv_decoder_p d, char *buf, size_t size) {
+    size_t len;
+
+#ifdef HAVE_PTHREAD_H
+    if (d->threaded) {
+        pthread_mutex_lock(&d->lock);
+        while (d->count == 0 && !d->done)
+            pthread_cond_wait(&d->cv, &d->lock);
+        if (d->count == 0) {
+            pthread_mutex_unlock(&d->lock);
+            len = 0;
+        } else {
+            int slot = d->head;
+            len = d->lengths[slot] - d->offset;
+            if (len > size) len = size;
+            memcpy(buf, d->blocks[slot] + d->offset, len);
+            d->offset += len;
+            if (d->offset == d->lengths[slot]) {
+                d->offset = 0;
+                d->head = (d->head + 1) % CSV_DECODER_BLOCKS;
+                d->count--;
+                pthread_cond_broadcast(&d->cv);
+            }
+            pthread_mutex_unlock(&d->lock);
+            return len;
+        }
+    } else
+#endif
+    len = decode(d, buf, size);
+
+    if (len == 0 && d->error && !d->reported) {
+        d->reported = 1;
+        return -1;
+    }
+    return len;
+}
+
+/*  csv_decoder_error --- the error message, if any */
+const char *
+csv_decoder_error(csv_decoder_p d) {
+    return d->error;
+}
+
+/*  csv_decoder_close --- stop decompressing and free memory. The file is not closed */
+void
+csv_decoder_close(csv_decoder_p d) {
+#ifdef HAVE_PTHREAD_H
+    int k;
+
+    if (d->threaded) {
+        pthread_mutex_lock(&d->lock);
+        d->shutdown = 1;
+        pthread_cond_broadcast(&d->cv);
+        pthread_mutex_unlock(&d->lock);
+        pthread_join(d->thread, NULL);
+    }
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->cv);
+    for (k = 0; k < CSV_DECODER_BLOCKS; k++)
+        gawk_free(d->blocks[k]);
+#endif
+#ifdef CSV_USE_ZLIB
+    if (d->format == CSV_GZIP) inflateEnd(&d->zs);
+#endif
+#ifdef CSV_USE_ZSTD
+    if (d->format == CSV_ZSTD) ZSTD_freeDStream(d->zds);
+#endif
+    gawk_free(d->in);
+    gawk_free(d);
+}
@@ -0,0 +1,32 @@
+#ifndef CSV_DECOMPRESS_H__
+#define CSV_DECOMPRESS_H__
+
+//#include "common_aux.h"
+
+#include <sys/types.h>
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#define CSV_USE_ZLIB 1
+#endif
+
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define CSV_USE_ZSTD 1
+#endif
+
+/* Compression formats */
+#define CSV_PLAIN   0
+#define CSV_GZIP    1
+#define CSV_ZSTD    2
+
+#define CSV_DECODER_BLOCKS 4        /* decompressed blocks ahead of the parser */
+
+typedef struct csv_decoder * csv_decoder_p;
+
+/* Function prototypes */
+int csv_compression(const unsigned char *magic, size_t len);
+csv_decoder_p csv_decoder_open(int fd, int format, const char *pending, size_t len);
+ssize_t csv_decoder_read(csv_decoder_p dec, char *buf, size_t size);
+const char *csv_decoder_error(csv_decoder_p dec);
+void csv_decoder_close(csv_decoder_p dec);
+
+#endif
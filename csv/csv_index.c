@@ -0,0 +1,150 @@
+/*
+ * csv_index.c - Record offset index of csv files.
+ */
+
+/*
+ * Copyright (C) 2018 the Free Software Foundation, Inc.
+ *
+ * This file is part of gawk-csv, the GAWK extension for handling CSV data.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/*
+ * The index keeps the byte offset of every step-th record, so that a
+ * record can be found by parsing at most step records. Quoted fields
+ * may contain newlines, so records cannot be found by counting lines.
+ *
+ * The sidecar file is a header followed by one 64 bit offset per entry,
+ * in the byte order of the machine. The header identifies the indexed
+ * file by its size and modification time: if the file changes, the
+ * index is built again. Entries are written as the records are read,
+ * so that an interrupted job leaves a usable index behind.
+ */
+
+#include "common_aux.h"
+#include <stdint.h>
+
+#include "csv_index.h"
+
+#define INDEX_MAGIC "CSVINDX1"
+
+struct index_header {
+    char magic[8];          /* INDEX_MAGIC */
+    uint64_t step;          /* records between entries */
+    uint64_t size;          /* size of the indexed file */
+    int64_t mtime;          /* modification time of the indexed file */
+};
+
+struct csv_index {
+    FILE *fp;               /* sidecar file, NULL after a write error */
+    long step;              /* records between entries */
+    off_t *offsets;         /* offsets[k] = start of the record k*step */
+    long count;             /* number of entries in the above */
+    long capacity;          /* capacity of the above */
+};
+
+
+/*  append --- add an entry in memory */
+static void
+append(csv_index_p idx, off_t offset) {
+    if (idx->count == idx->capacity) {
+        idx->capacity = idx->capacity ? 2 * idx->capacity : 256;
+        erealloc(idx->offsets, off_t *, idx->capacity * sizeof(off_t), "csv_index_add");
+    }
+    idx->offsets[idx->count++] = offset;
+}
+
+/*  load --- read the entries of a valid sidecar file. Return 0 if not valid */
+static int
+load(csv_index_p idx, const struct stat *st) {
+    struct index_header h;
+    uint64_t offset;
+
+    if (fread(&h, sizeof(h), 1, idx->fp) != 1
+        || memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) != 0
+        || h.step != (uint64_t) idx->step
+        || h.size != (uint64_t) st->st_size
+        || h.mtime != (int64_t) st->st_mtime)
+        return 0;
+    /* offsets must increase: stop at a damaged or partial entry */
+    while (fread(&offset, sizeof(offset), 1, idx->fp) == 1
+           && offset < h.size
+           && (idx->count == 0 || (off_t) offset > idx->offsets[idx->count - 1]))
+        append(idx, (off_t) offset);
+    /* new entries go after the valid ones */
+    return fseek(idx->fp, (long)(sizeof(h) + idx->count * sizeof(offset)), SEEK_SET) == 0;
+}
+
+
+/*  csv_index_open --- open the index of fd in the sidecar file name, or create it.
+ *  Return NULL on failure */
+csv_index_p
+csv_index_open(const char *name, int fd, long step) {
+    csv_index_p idx;
+    struct stat st;
+    struct index_header h;
+
+    if (step <= 0 || fstat(fd, &st) < 0) return NULL;
+    ezalloc(idx, csv_index_p, sizeof(*idx), "csv_index_open");
+    idx->step = step;
+
+    if ((idx->fp = fopen(name, "r+b")) != NULL && load(idx, &st))
+        return idx;
+
+    /* missing, stale or damaged: start a new one */
+    if (idx->fp) fclose(idx->fp);
+    idx->count = 0;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.step = step;
+    h.size = st.st_size;
+    h.mtime = st.st_mtime;
+    if ((idx->fp = fopen(name, "w+b")) == NULL
+        || fwrite(&h, sizeof(h), 1, idx->fp) != 1) {
+        if (idx->fp) fclose(idx->fp);
+        gawk_free(idx->offsets);
+        gawk_free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+/*  csv_index_add --- note the offset of a record (0 = the first one).
+ *  Only the next missing entry is added */
+void
+csv_index_add(csv_index_p idx, long record, off_t offset) {
+    uint64_t entry = offset;
+
+    if (record % idx->step != 0 || record / idx->step != idx->count) return;
+    append(idx, offset);
+    if (idx->fp && (fwrite(&entry, sizeof(entry), 1, idx->fp) != 1 || fflush(idx->fp) != 0)) {
+        fclose(idx->fp);        /* keep the index in memory only */
+        idx->fp = NULL;
+    }
+}
+
+/*  csv_index_lookup --- find the nearest known record at or before record.
+ *  Return its number and set its offset, or return -1 if none is known */
+long
+csv_index_lookup(csv_index_p idx, long record, off_t *offset) {
+    long k = record / idx->step;
+
+    if (k >= idx->count) k = idx->count - 1;
+    if (k < 0) return -1;
+    *offset = idx->offsets[k];
+    return k * idx->step;
+}
+
+/*  csv_index_close --- close the sidecar file and free memory.
+ *  Return 0, or EOF if the sidecar file could not be written */
+int
+csv_index_close(csv_index_p idx) {
+    int ret = (idx->fp && fclose(idx->fp) == 0) ? 0 : EOF;
+
+    gawk_free(idx->offsets);
+    gawk_free(idx);
+    return ret;
+}
@@ -0,0 +1,20 @@
+#ifndef CSV_INDEX_H__
+#define CSV_INDEX_H__
+
+//#include "common_aux.h"
+
+#include <sys/types.h>
+
+#ifndef CSV_INDEX_STEP
+#define CSV_INDEX_STEP 1000        /* default records between index entries */
+#endif
+
+typedef struct csv_index * csv_index_p;
+
+/* Function prototypes */
+csv_index_p csv_index_open(const char *name, int fd, long step);
+void csv_index_add(csv_index_p idx, long record, off_t offset);
+long csv_index_lookup(csv_index_p idx, long record, off_t *offset);
+int csv_index_close(csv_index_p idx);
+
+#endif
@@ -13,110 +13,176 @@
  */
 
 #include "common_aux.h"
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+#ifndef HAVE_CLOCK_GETTIME
+#include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include "strbuf.h"
 #include "csv_parser.h"
+#include "csv_scan.h"
 #include "csv_input.h"
+#include "csv_threads.h"
+#include "csv_decompress.h"
+#include "csv_index.h"
 #include "awk_fieldwidth_info.h"
 
-/* Shared among handlers */
-static csv_reader_p rdr;
-static int fd;
-static csv_parser_p parser;
-static strbuf_p input;
-static strbuf_p awk_rec;
-static char csv_quote;
-static char *csv_fs;
-static int csv_fs_len;
-static int after_cr;
-static awk_bool_t inside_quotes;
-static int fieldcount = 0;
+/* The reader that contains a given parser */
+#define READER(p) ((csv_reader_p) ((char *) (p) - offsetof(struct csv_reader, parser)))
 
-#if gawk_api_major_version >= 2
-static int field_skip = 0;
-static int field_len = 0;
+
+static double csv_clock(void) {  /* seconds from some fixed time */
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
 #endif
+}
+
+static int fill_buffer(csv_reader_p r) {  /* refill the raw input buffer */
+    ssize_t len;
+    double start = 0;
 
+    if (r->mapped) return 0;        /* the buffer already holds the whole file */
+    if (r->timing) start = csv_clock();
+    r->buf_offset += r->buf_len;
+    if (r->decoder) {
+        len = csv_decoder_read(r->decoder, r->buffer, CSV_INPUT_BUFSIZE);
+        if (len < 0) nonfatal(ext_id, "csvinput: %s", csv_decoder_error(r->decoder));
+    } else do {
+        len = read(r->fd, r->buffer, CSV_INPUT_BUFSIZE);
+    } while (len < 0 && errno == EINTR);
+    r->buf_pos = 0;
+    r->buf_len = (len > 0) ? len : 0;
+    ++r->stats.refills;
+    if (r->timing) r->stats.read_time += csv_clock() - start;
+    return r->buf_len > 0;
+}
 
-static unsigned char next_char() {  /* get the next input char */
+static inline unsigned char read_char(csv_parser_p p, unsigned char quote) {  /* get the next input char */
+    csv_reader_p r = READER(p);
     unsigned char c;
-    int len;
-    
-    /* get a previous char or read a new one */
-    if (after_cr >= 0) {
-        c = after_cr;
-        len = 1;
-        after_cr = -1;
-    } else {
-        len = read(fd, &c, 1);
-    }
     
     /* end of file */
-    if (len == 0) return CSV_NULL;
+    if (r->buf_pos >= r->buf_len && !fill_buffer(r)) return CSV_NULL;
+    c = r->buffer[r->buf_pos++];
     
     /* check for end of record */
-    if (!inside_quotes) {
+    if (!r->inside_quotes) {
         if (c == CSV_CR) {
-            rdr->rt[rdr->rt_len++] = c;
-            if ((len = read(fd, &c, 1)) > 0) {
-                if (c == CSV_LF) {
-                    rdr->rt[rdr->rt_len++] = c;
-                } else {
-                    after_cr = c;
-                }
+            r->rt[r->rt_len++] = c;
+            /* a LF just after the CR, maybe in the next block, is part of RT */
+            if ((r->buf_pos < r->buf_len || fill_buffer(r)) && r->buffer[r->buf_pos] == CSV_LF) {
+                r->rt[r->rt_len++] = CSV_LF;
+                ++r->buf_pos;
             }
             return CSV_NULL;
         } else if (c == CSV_LF) {
-            rdr->rt[rdr->rt_len++] = c;
+            r->rt[r->rt_len++] = c;
             return CSV_NULL;
         }
     }
     
     /* process the char */
-    if (c == csv_quote) {
-        inside_quotes = !inside_quotes;
+    if (c == quote) {
+        r->inside_quotes = !r->inside_quotes;
     }
-    strbuf_put_char(input, c);
+    strbuf_put_char(&(*r).csv_record, c);
     return c;
 }
 
-static void begin_field() {         /* start a new output field */
-    if (fieldcount) {
-        strbuf_put_string(awk_rec, csv_fs);
+static unsigned char next_char(csv_parser_p p) {  /* get the next input char */
+    return read_char(p, p->quote_char);
+}
+
+static const unsigned char *peek_chars(csv_parser_p p, size_t *len) {  /* view the pending input chars */
+    csv_reader_p r = READER(p);
+    if (r->buf_pos >= r->buf_len) fill_buffer(r);
+    *len = r->buf_len - r->buf_pos;
+    return (const unsigned char *) &(*r).buffer[r->buf_pos];
+}
+
+static void skip_chars(csv_parser_p p, size_t len) {  /* consume input chars, after peek_chars */
+    csv_reader_p r = READER(p);
+    /* the parser only skips ordinary chars, no quotes or newlines */
+    strbuf_put_chars(&(*r).csv_record, &(*r).buffer[r->buf_pos], len);
+    r->buf_pos += len;
+}
+
+static int is_selected(csv_reader_p r, int column) {  /* the column goes to the awk record */
+    return !r->columns || (column <= r->max_column && r->columns[column]);
+}
+
+static void begin_field(csv_parser_p p) {  /* start a new output field */
+    csv_reader_p r = READER(p);
+    /* the char just read is the opening quote of a quoted field */
+    if (r->csv_record.length > 0
+        && (unsigned char) r->csv_record.str[r->csv_record.length - 1] == p->quote_char)
+        ++r->stats.quoted;
+    r->selected = is_selected(r, r->fieldcount + 1);
+    if (r->selected && r->outcount) {
+        strbuf_put_string(&(*r).awk_record, r->csv_fs);
 #if gawk_api_major_version >= 2
-        field_skip = csv_fs_len;
+        r->field_skip = r->csv_fs_len;
     }
-    field_len = 0;
+    r->field_len = 0;
 #else
     }
 #endif
 }
 
-static void end_field() {           /* end of the current output field */
-    ++fieldcount;
+static void end_field(csv_parser_p p) {  /* end of the current output field */
+    csv_reader_p r = READER(p);
+    ++r->fieldcount;
+    if (!r->selected) return;
+    ++r->outcount;
 #if gawk_api_major_version >= 2
-    rdr->max_fields = awk_fieldwidth_info_add(&(*rdr).csv_fields, rdr->max_fields, field_skip, field_len);
-    field_skip = 0;
-    field_len =0;
+    r->max_fields = awk_fieldwidth_info_add(&(*r).csv_fields, r->max_fields, r->field_skip, r->field_len);
+    r->field_skip = 0;
+    r->field_len = 0;
 #endif
 }
 
-static void mark_field() {          /* mark the current output field position */
+static void mark_field(csv_parser_p p __UNUSED) {  /* mark the current output field position */
     // /* RESERVED FOR FUTURE USE */
 }
 
-static void backspace_field() {     /* discard data after the current output field mark */
+static void backspace_field(csv_parser_p p __UNUSED) {  /* discard data after the current output field mark */
     // /* RESERVED FOR FUTURE USE */
 }
 
-static void put_char(unsigned char c) { /* append a character to the current output field */
-    strbuf_put_char(awk_rec, c);
+static void put_char(csv_parser_p p, unsigned char c) { /* append a character to the current output field */
+    csv_reader_p r = READER(p);
+    if (!r->selected) return;       /* the column is not wanted */
+    strbuf_put_char(&(*r).awk_record, c);
+#if gawk_api_major_version >= 2
+    ++r->field_len;
+#endif
+}
+
+static void put_chars(csv_parser_p p, const unsigned char *s, size_t len) { /* append a run of chars to the current output field */
+    csv_reader_p r = READER(p);
+    if (!r->selected) return;       /* the column is not wanted */
+    strbuf_put_chars(&(*r).awk_record, (const char *) s, len);
 #if gawk_api_major_version >= 2
-    ++field_len;
+    r->field_len += len;
 #endif
 }
 
-static void error(const char* msg) { /* report error message */
+static void error(csv_parser_p p, const char* msg) { /* report error message */
+    csv_reader_p r = READER(p);
+    strbuf_p input = &(*r).csv_record;
     const int WIDTH = 65;
     const int TAIL = 10;
     const int DOTS = 3;
@@ -129,6 +195,7 @@ static void error(const char* msg) { /* report error message */
     int last = len;
     char buffer[WIDTH+1];
 
+    ++r->stats.errors;
     if (len > WIDTH) {            /* too long record */
         if (len > pos + TAIL) {   /* truncate at the end */
             last = pos + TAIL;
@@ -146,17 +213,43 @@ static void error(const char* msg) { /* report error message */
         }
     }
 
+    if (r->errors) {
+        /* not in the gawk thread: keep the message, '\0' terminated, for later */
+        char text[2*WIDTH+256];
+        snprintf(text, sizeof(text), "csvinput: %s\n  %s\n  %*c", msg, textline, cursor, '^');
+        strbuf_put_chars(r->errors, text, strlen(text) + 1);
+        return;
+    }
     nonfatal(ext_id, "csvinput: %s\n  %s\n  %*c", msg, textline, cursor, '^');
 }
 
 
+/* The parser kernel, calling the functions above directly */
+#define KERNEL_NEXT_CHAR(p)          read_char(p, quote)
+#define KERNEL_BEGIN_FIELD(p)        begin_field(p)
+#define KERNEL_END_FIELD(p)          end_field(p)
+#define KERNEL_PUT_CHAR(p, c)        put_char(p, c)
+#define KERNEL_ERROR(p, msg)         error(p, msg)
+#define KERNEL_HAS_RUNS(p)           1
+#define KERNEL_PEEK_CHARS(p, lenp)   peek_chars(p, lenp)
+#define KERNEL_SKIP_CHARS(p, len)    skip_chars(p, len)
+#define KERNEL_PUT_CHARS(p, s, len)  put_chars(p, s, len)
+
+#include "csv_kernel.h"
+
+
 /* Create a csv input reader */
 void csv_reader_init(csv_reader_p reader, int fdes, int csvmode, char csvcomma, char csvquote, char *csvfs, int csvfslen) {
     reader->fd = fdes;              /* input file descriptor */
     reader->csv_mode = csvmode;     /* input mode */
     reader->csv_fs = csvfs;         /* awk_record field separator */
     reader->csv_fs_len = csvfslen;  /* length of the above */
-    reader->after_cr = -1;          /* character after CR, pending, -1 = none */
+    emalloc(reader->buffer, char *, CSV_INPUT_BUFSIZE, "csv_reader_init");
+    reader->buf_pos = 0;            /* raw input buffer is empty */
+    reader->buf_len = 0;
+    reader->buf_offset = 0;
+    reader->mapped = 0;
+    reader->decoder = NULL;
 
     reader->parser.delim_char = csvcomma;  /* input parser ... */
     reader->parser.quote_char = csvquote;
@@ -167,10 +260,22 @@ void csv_reader_init(csv_reader_p reader, int fdes, int csvmode, char csvcomma,
     reader->parser.backspace_field = &backspace_field;
     reader->parser.put_char = &put_char;
     reader->parser.error = &error;
+    reader->parser.peek_chars = &peek_chars;
+    reader->parser.skip_chars = &skip_chars;
+    reader->parser.put_chars = &put_chars;
 
     strbuf_init(&(*reader).csv_record);    /* original CSV record */
     strbuf_init(&(*reader).awk_record);    /* equivalent awk record */
-    fieldcount = 0;
+    reader->errors = NULL;         /* report errors at once */
+    reader->pool = NULL;           /* single threaded */
+    reader->index = NULL;          /* no record offset index */
+    reader->records = 0;
+    reader->header = 0;
+    memset(&(*reader).stats, 0, sizeof(reader->stats));
+    reader->timing = 0;
+    reader->columns = NULL;        /* deliver all columns */
+    reader->max_column = 0;
+    reader->selected = 1;
 #if gawk_api_major_version >= 2
     reader->max_fields = awk_fieldwidth_info_init(&(*reader).csv_fields);
     reader->csv_fields->use_chars = awk_false;
@@ -178,41 +283,406 @@ void csv_reader_init(csv_reader_p reader, int fdes, int csvmode, char csvcomma,
     reader->rt_len = 0;            /* length of the record terminator */
 }
 
-/* Read the next csv record */
-int csv_read(csv_reader_p reader) {
-    rdr = reader;
-    fd = rdr->fd;
-    csv_fs = rdr->csv_fs;
-    csv_fs_len = rdr->csv_fs_len;
-    after_cr = rdr->after_cr;
-    rdr->rt_len = 0;
-    input = &(*rdr).csv_record;
-    awk_rec = &(*rdr).awk_record;
-    parser = &(*rdr).parser;
-    csv_quote = parser->quote_char;
-    inside_quotes = awk_false;
-    fieldcount = 0;
-#if gawk_api_major_version >= 2
-    field_skip = 0;
-    field_len = 0;
+/* Deliver only some columns, given as a list like "3,7,12".
+ * The columns keep their order in the input record.
+ * Return 0 if the list is not valid */
+int csv_reader_columns(csv_reader_p reader, const char *list) {
+    const char *s;
+    char *end;
+    long column;
+    int max = 0;
+
+    /* validate, and find the highest column */
+    for (s = list; ; s = end + 1) {
+        while (*s == ' ') s++;
+        column = strtol(s, &end, 10);
+        if (end == s || column < 1 || column > INT_MAX - 1) return 0;
+        if (column > max) max = column;
+        while (*end == ' ') end++;
+        if (*end == '\0') break;
+        if (*end != ',') return 0;
+    }
+
+    gawk_free(reader->columns);
+    ezalloc(reader->columns, unsigned char *, max + 1, "csv_reader_columns");
+    reader->max_column = max;
+    for (s = list; ; s = end + 1) {
+        reader->columns[strtol(s, &end, 10)] = 1;
+        while (*end == ' ') end++;
+        if (*end == '\0') break;
+    }
+    return 1;
+}
+
+/* Decompress the input on the fly, if it is compressed.
+ * The first bytes are examined in place if the file is seekable, or
+ * else read into the buffer, where they stay if it is not compressed */
+int csv_reader_decompress(csv_reader_p reader) {
+    unsigned char magic[4];
+    size_t len = 0;
+    off_t start;
+    ssize_t n;
+    int format;
+
+    if ((start = lseek(reader->fd, 0, SEEK_CUR)) >= 0) {
+        if ((n = pread(reader->fd, magic, sizeof(magic), start)) > 0) len = n;
+        format = csv_compression(magic, len);
+        if (format == CSV_PLAIN) return 0;
+        reader->decoder = csv_decoder_open(reader->fd, format, NULL, 0);
+    } else {
+        if (reader->buf_pos >= reader->buf_len) fill_buffer(reader);
+        len = reader->buf_len - reader->buf_pos;
+        format = csv_compression((unsigned char *) &(*reader).buffer[reader->buf_pos], len);
+        if (format == CSV_PLAIN) return 0;
+        reader->decoder = csv_decoder_open(reader->fd, format, &(*reader).buffer[reader->buf_pos], len);
+        if (reader->decoder) reader->buf_pos = reader->buf_len = 0;
+    }
+    return reader->decoder != NULL;
+}
+
+/* Read a regular file through a memory mapping, if possible */
+int csv_reader_map(csv_reader_p reader, off_t size) {
+#ifdef CSV_USE_MMAP
+    void *map;
+    off_t start;
+
+    if (size <= 0 || (off_t)(size_t) size != size) return 0;
+    if ((start = lseek(reader->fd, 0, SEEK_CUR)) < 0 || start > size) return 0;
+    map = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+    if (map == MAP_FAILED) return 0;
+#ifdef MADV_SEQUENTIAL
+    (void) madvise(map, (size_t) size, MADV_SEQUENTIAL);
+#endif
+    gawk_free(reader->buffer);
+    reader->buffer = map;
+    reader->buf_pos = start;
+    reader->buf_len = size;
+    reader->mapped = 1;
+    return 1;
+#else
+    return 0;
 #endif
+}
+
+/* Parse a mapped file with several threads, if possible */
+int csv_reader_threads(csv_reader_p reader, int nthreads) {
+    reader->pool = csv_pool_start(reader, nthreads);
+    return reader->pool != NULL;
+}
+
+/* Keep a record offset index in a sidecar file, with an entry every step records.
+ * Only for plain files that can be read again from any offset.
+ * Return 0 if the index cannot be used */
+int csv_reader_index(csv_reader_p reader, const char *name, long step) {
+    off_t start;
 
-    strbuf_start(input);
-    strbuf_start(awk_rec);
+    if (reader->decoder || reader->pool) return 0;
+    if ((start = lseek(reader->fd, 0, SEEK_CUR)) < 0) return 0;
+    if (!reader->mapped) reader->buf_offset = start - (off_t) reader->buf_len;
+    reader->index = csv_index_open(name, reader->fd, step);
+    return reader->index != NULL;
+}
+
+/* Read the first record as a header, before any other.
+ * csv_reader_seek does not count it as a data record.
+ * Return its length, or -1 if there is none */
+int csv_reader_header(csv_reader_p reader) {
+    int len = csv_read(reader);
+    if (len >= 0) reader->header = 1;
+    return len;
+}
+
+/* Go to a record, 1 being the first one, so that the next csv_read delivers it.
+ * The header, if any, is not counted.
+ * The nearest indexed record is found, and the records after it are skipped.
+ * Return 0 if there is no index, or if the file has fewer records */
+int csv_reader_seek(csv_reader_p reader, long record) {
+    long target = record - 1 + reader->header;   /* records to skip */
+    long known;
+    off_t offset;
+
+    if (!reader->index || record < 1) return 0;
+    known = csv_index_lookup(reader->index, target, &offset);
+    /* start from the index, unless the current position is nearer */
+    if (known >= 0 && (reader->records > target || reader->records < known)) {
+        if (reader->mapped) {
+            reader->buf_pos = offset;
+        } else {
+            if (lseek(reader->fd, offset, SEEK_SET) < 0) return 0;
+            reader->buf_offset = offset;
+            reader->buf_pos = reader->buf_len = 0;
+        }
+        reader->records = known;
+    } else if (known < 0 && reader->records > target) {
+        return 0;               /* the first record is not known yet */
+    }
+    while (reader->records < target) {
+        if (csv_read(reader) < 0) return 0;
+    }
+    return 1;
+}
+
+/* quick_read --- deliver a record without quotes straight from the mapped file.
+ * If all columns are wanted, only valid if the awk field separator is the
+ * CSV delimiter, so that the awk record is the CSV record itself. Otherwise
+ * the wanted columns are copied to awk_record.
+ * Return -2 if the record must go through the full parser. */
+static int quick_read(csv_reader_p reader) {
+    const unsigned char *s = (const unsigned char *) reader->buffer;
+    size_t start = reader->buf_pos;
+    size_t end = reader->buf_len;
+    size_t pos = start;
+    size_t run;
+    unsigned char delim = reader->parser.delim_char;
+    unsigned char quote = reader->parser.quote_char;
+    unsigned char c;
+    int nfields = 0;
+    int outcount = 0;
+    int len;
+
+    if (reader->columns) strbuf_start(&(*reader).awk_record);
 #if gawk_api_major_version >= 2
     awk_fieldwidth_info_start(reader->csv_fields);
 #endif
-    csv_parse(parser);
+    for (;;) {
+        run = csv_scan(s + pos, end - pos, delim, quote);
+        c = (pos + run < end) ? s[pos + run] : CSV_LF;
+        if (c != delim && c != CSV_CR && c != CSV_LF) {
+            return -2;      /* a quote or a NUL: needs the parser */
+        } else if (c != delim && nfields == 0 && run == 0) {
+            break;          /* empty record */
+        }
+        ++nfields;
+        if (!reader->columns) {
+#if gawk_api_major_version >= 2
+            reader->max_fields = awk_fieldwidth_info_add(&(*reader).csv_fields, reader->max_fields, nfields > 1 ? 1 : 0, run);
+#endif
+        } else if (is_selected(reader, nfields)) {
+            if (outcount++) strbuf_put_string(&(*reader).awk_record, reader->csv_fs);
+            strbuf_put_chars(&(*reader).awk_record, (const char *) s + pos, run);
+#if gawk_api_major_version >= 2
+            reader->max_fields = awk_fieldwidth_info_add(&(*reader).csv_fields, reader->max_fields, outcount > 1 ? reader->csv_fs_len : 0, run);
+#endif
+        }
+        pos += run;
+        if (c != delim) break;
+        ++pos;
+    }
 
-    rdr->after_cr = after_cr;
-    int len = awk_rec->length;
+    /* record terminator */
+    len = pos - start;
+    reader->rt_len = 0;
+    if (pos < end) {
+        reader->rt[reader->rt_len++] = s[pos++];
+        if (s[pos-1] == CSV_CR && pos < end && s[pos] == CSV_LF) {
+            reader->rt[reader->rt_len++] = s[pos++];
+        }
+    }
+    reader->buf_pos = pos;
+    reader->fieldcount = nfields;
+    reader->csv_out = reader->buffer + start;
+    reader->csv_out_len = len;
     if (len <= 0) return -1;
+
+    if (reader->columns) {
+        reader->awk_out = strbuf_value(&(*reader).awk_record);
+        return reader->awk_record.length;
+    }
+    reader->awk_out = reader->csv_out;
+    return len;
+}
+
+/* find_eol --- offset of the first CR or LF in s, or len */
+static size_t find_eol(const char *s, size_t len) {
+    size_t k = 0;
+    /* csv_scan also stops at NUL, an ordinary char here */
+    while ((k += csv_scan((const unsigned char *) s + k, len - k, CSV_LF, CSV_CR)) < len
+           && s[k] == CSV_NULL)
+        ++k;
+    return k;
+}
+
+/* plain_fields --- split a record without quotes at the delimiter.
+ * As in quick_read, the awk record is the record itself if possible. */
+static int plain_fields(csv_reader_p reader, char *s, size_t len) {
+    char delim = reader->parser.delim_char;
+    int copy = reader->columns || reader->csv_fs_len != 1 || reader->csv_fs[0] != delim;
+    char *end = s + len;
+    char *q;
+    int nfields = 0;
+    int outcount = 0;
+
+    if (copy) strbuf_start(&(*reader).awk_record);
+#if gawk_api_major_version >= 2
+    awk_fieldwidth_info_start(reader->csv_fields);
+#endif
+    for (;;) {
+        if ((q = memchr(s, delim, end - s)) == NULL) q = end;
+        ++nfields;
+        if (!copy) {
+#if gawk_api_major_version >= 2
+            reader->max_fields = awk_fieldwidth_info_add(&(*reader).csv_fields, reader->max_fields, nfields > 1 ? 1 : 0, q - s);
+#endif
+        } else if (is_selected(reader, nfields)) {
+            if (outcount++) strbuf_put_string(&(*reader).awk_record, reader->csv_fs);
+            strbuf_put_chars(&(*reader).awk_record, s, q - s);
+#if gawk_api_major_version >= 2
+            reader->max_fields = awk_fieldwidth_info_add(&(*reader).csv_fields, reader->max_fields, outcount > 1 ? reader->csv_fs_len : 0, q - s);
+#endif
+        }
+        if (q == end) break;
+        s = q + 1;
+    }
+    reader->fieldcount = nfields;
+
+    if (copy) {
+        reader->awk_out = strbuf_value(&(*reader).awk_record);
+        return reader->awk_record.length;
+    }
+    reader->awk_out = reader->csv_out;
+    return len;
+}
+
+/* plain_read --- read a record without quotes, if CSVQUOTE is empty.
+ * The record ends at the first CR or LF, and is delivered in place
+ * unless it spans two blocks of input. */
+static int plain_read(csv_reader_p reader) {
+    char *rec = NULL;
+    size_t len = 0;
+    size_t n, k;
+    unsigned char c;
+
+    reader->rt_len = 0;
+    reader->fieldcount = 0;
+    strbuf_start(&(*reader).csv_record);
+    for (;;) {
+        if (reader->buf_pos >= reader->buf_len && !fill_buffer(reader)) break;   /* end of file */
+        n = reader->buf_len - reader->buf_pos;
+        k = find_eol(reader->buffer + reader->buf_pos, n);
+        if (k == n) {   /* the record goes on in the next block */
+            strbuf_put_chars(&(*reader).csv_record, reader->buffer + reader->buf_pos, n);
+            reader->buf_pos += n;
+            continue;
+        }
+        if (reader->csv_record.length == 0) {
+            rec = reader->buffer + reader->buf_pos;
+            len = k;
+        } else {
+            strbuf_put_chars(&(*reader).csv_record, reader->buffer + reader->buf_pos, k);
+        }
+        reader->buf_pos += k;
+        c = reader->buffer[reader->buf_pos++];
+        reader->rt[reader->rt_len++] = c;
+        if (c == CSV_CR) {
+            /* the LF may be in the next block: save the record before reading it */
+            if (rec && reader->buf_pos == reader->buf_len && !reader->mapped) {
+                strbuf_put_chars(&(*reader).csv_record, rec, len);
+                rec = NULL;
+            }
+            if ((reader->buf_pos < reader->buf_len || fill_buffer(reader))
+                && reader->buffer[reader->buf_pos] == CSV_LF) {
+                reader->rt[reader->rt_len++] = CSV_LF;
+                ++reader->buf_pos;
+            }
+        }
+        break;
+    }
+    if (rec == NULL) {
+        rec = strbuf_value(&(*reader).csv_record);
+        len = reader->csv_record.length;
+    }
+    reader->csv_out = rec;
+    reader->csv_out_len = len;
+    if (len == 0) return -1;
+    return plain_fields(reader, rec, len);
+}
+
+/* read_record --- read the next csv record */
+static int read_record(csv_reader_p reader) {
+    if (reader->pool) return csv_pool_read(reader->pool, reader);
+    if (reader->parser.quote_char == CSV_NULL) return plain_read(reader);
+    if (reader->mapped && (reader->columns || (reader->csv_fs_len == 1
+        && reader->csv_fs[0] == (char) reader->parser.delim_char))) {
+        int len = quick_read(reader);
+        if (len != -2) return len;
+    }
+
+    reader->rt_len = 0;
+    reader->inside_quotes = 0;
+    reader->fieldcount = 0;
+    reader->outcount = 0;
+#if gawk_api_major_version >= 2
+    reader->field_skip = 0;
+    reader->field_len = 0;
+#endif
+
+    strbuf_start(&(*reader).csv_record);
+    strbuf_start(&(*reader).awk_record);
+#if gawk_api_major_version >= 2
+    awk_fieldwidth_info_start(reader->csv_fields);
+#endif
+    csv_parse_kernel(&(*reader).parser);
+
+    reader->awk_out = strbuf_value(&(*reader).awk_record);
+    reader->csv_out = strbuf_value(&(*reader).csv_record);
+    reader->csv_out_len = reader->csv_record.length;
+    int len = reader->awk_record.length;
+    /* with some columns, the awk record may be empty but not the input one */
+    if ((reader->columns ? reader->csv_record.length : len) <= 0) return -1;
     
     return len;
 }
 
+/* Read the next csv record */
+int csv_read(csv_reader_p reader) {
+    off_t start = reader->buf_offset + (off_t) reader->buf_pos;
+    double clock = 0, read_time = 0;
+    int len;
+
+    if (reader->timing) {
+        clock = csv_clock();
+        read_time = reader->stats.read_time;
+    }
+    len = read_record(reader);
+    if (reader->timing) {
+        reader->stats.parse_time += (csv_clock() - clock) - (reader->stats.read_time - read_time);
+    }
+    if (len < 0) return len;
+
+    /* the worker threads count their chunks */
+    ++reader->stats.records;
+    if (!reader->pool) {
+        reader->stats.bytes += reader->buf_offset + (off_t) reader->buf_pos - start;
+        reader->stats.fields += reader->fieldcount;
+    }
+    if (reader->index) csv_index_add(reader->index, reader->records++, start);
+    return len;
+}
+
+/* Add the counters of a reader to a total */
+void csv_stats_add(csv_stats_t *total, const csv_stats_t *stats) {
+    total->bytes += stats->bytes;
+    total->records += stats->records;
+    total->fields += stats->fields;
+    total->quoted += stats->quoted;
+    total->errors += stats->errors;
+    total->refills += stats->refills;
+    total->read_time += stats->read_time;
+    total->parse_time += stats->parse_time;
+}
+
 /* Destroy the csv input reader */
 void csv_reader_close(csv_reader_p reader) {
+    if (reader->pool) csv_pool_stop(reader->pool);
+    if (reader->decoder) csv_decoder_close(reader->decoder);
+    if (reader->index) (void) csv_index_close(reader->index);
+#ifdef CSV_USE_MMAP
+    if (reader->mapped) {
+        munmap(reader->buffer, reader->buf_len);
+    } else
+#endif
+    gawk_free(reader->buffer);
+    gawk_free(reader->columns);
     strbuf_free(&(*reader).csv_record);
     strbuf_free(&(*reader).awk_record);
 #if gawk_api_major_version >= 2
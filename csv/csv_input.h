@@ -6,21 +6,66 @@
 #include "strbuf.h"
 #include "csv_parser.h"
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define CSV_USE_MMAP 1
+#endif
+
+#ifndef CSV_INPUT_BUFSIZE
+#define CSV_INPUT_BUFSIZE 65536    /* size of the raw input buffer */
+#endif
+
+/* Input counters of a csv reader */
+typedef struct csv_stats {
+    long long bytes;        /* input bytes parsed */
+    long long records;      /* records delivered */
+    long long fields;       /* input fields of the above */
+    long long quoted;       /* quoted fields */
+    long long errors;       /* parse errors reported */
+    long long refills;      /* raw input buffer refills */
+    double read_time;       /* seconds waiting for input, if timed */
+    double parse_time;      /* seconds parsing, if timed */
+} csv_stats_t;
+
 typedef struct csv_reader {
     int fd;                 /* input file descriptor */
     int csv_mode;           /* input mode */
     char *csv_fs;           /* awk_record field separator */
     int csv_fs_len;         /* length of the above */
-    int after_cr;           /* character after CR, pending, -1 = none */
+    char *buffer;           /* raw input data, refilled by read() */
+    size_t buf_pos;         /* next unread char in the above */
+    size_t buf_len;         /* amount of valid data in the above */
+    off_t buf_offset;       /* file offset of the buffer, if not mapped */
+    int mapped;             /* buffer is the whole file, mapped in memory */
+    struct csv_decoder *decoder;  /* decompresses the input, if not NULL */
     csv_parser_t parser;    /* input parser */
     strbuf_t csv_record;    /* original CSV record */
     strbuf_t awk_record;    /* equivalent awk record */
+    char *awk_out;          /* awk record delivered, maybe the mapped file */
+    char *csv_out;          /* CSV record delivered, maybe the mapped file */
+    int csv_out_len;        /* length of the above */
 #if gawk_api_major_version >= 2
     awk_fieldwidth_info_t *csv_fields; /* field positions */
     int max_fields;         /* capacity of the above */
 #endif
     char rt[3];             /* record terminator */
     int rt_len;             /* length of the record terminator */
+    int inside_quotes;      /* odd number of quotes seen in the record */
+    int fieldcount;         /* number of completed fields */
+    int outcount;           /* number of fields put in the awk record */
+    int selected;           /* the current field goes to the awk record */
+    unsigned char *columns; /* selected columns, NULL = all */
+    int max_column;         /* highest column in the above */
+#if gawk_api_major_version >= 2
+    int field_skip;         /* separator length before the current field */
+    int field_len;          /* length of the current field */
+#endif
+    strbuf_p errors;        /* keep error messages here, if not NULL */
+    struct csv_pool *pool;  /* worker threads parsing the mapped file, if any */
+    struct csv_index *index; /* record offset index, if not NULL */
+    long records;           /* number of records read, with an index */
+    int header;             /* the first record is a header, not data */
+    csv_stats_t stats;      /* input counters */
+    int timing;             /* measure read_time and parse_time */
 } csv_reader_t;
 
 typedef struct csv_reader * csv_reader_p;
@@ -28,9 +73,33 @@ typedef struct csv_reader * csv_reader_p;
 /* Create a csv input reader */
 void csv_reader_init(csv_reader_p reader, int fd, int csvmode, char csvcomma, char csvquote, char *csvfs, int csvfslen);
 
+/* Deliver only some columns, given as a list like "3,7,12" */
+int csv_reader_columns(csv_reader_p reader, const char *list);
+
+/* Decompress the input on the fly, if it is compressed */
+int csv_reader_decompress(csv_reader_p reader);
+
+/* Read a regular file through a memory mapping, if possible */
+int csv_reader_map(csv_reader_p reader, off_t size);
+
+/* Keep a record offset index in a sidecar file */
+int csv_reader_index(csv_reader_p reader, const char *name, long step);
+
+/* Read the first record as a header */
+int csv_reader_header(csv_reader_p reader);
+
+/* Go to a record, 1 being the first one, using the index */
+int csv_reader_seek(csv_reader_p reader, long record);
+
+/* Parse a mapped file with several threads, if possible */
+int csv_reader_threads(csv_reader_p reader, int nthreads);
+
 /* Read the next csv record */
 int csv_read(csv_reader_p reader);
 
+/* Add the counters of a reader to a total */
+void csv_stats_add(csv_stats_t *total, const csv_stats_t *stats);
+
 /* Destroy the csv input reader */
 void csv_reader_close(csv_reader_p reader);
 
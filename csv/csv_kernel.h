@@ -0,0 +1,205 @@
+/*
+ * csv_kernel.h - The csv parser, compiled into each of its consumers.
+ */
+
+/*
+ * Copyright (C) 2018 the Free Software Foundation, Inc.
+ *
+ * This file is part of gawk-csv, the GAWK extension for handling CSV data.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/*
+ * csv_parse() calls its consumer through function pointers for every
+ * char. Here the same state machine is written once as an inline
+ * function, and a consumer includes this file after defining its
+ * callbacks as macros:
+ *
+ *   KERNEL_NEXT_CHAR(p)          get the next input char, 0 at the end
+ *   KERNEL_BEGIN_FIELD(p)        start a new output field
+ *   KERNEL_END_FIELD(p)          end the current output field
+ *   KERNEL_PUT_CHAR(p, c)        append a char to the current field
+ *   KERNEL_ERROR(p, msg)         report an error message
+ *   KERNEL_HAS_RUNS(p)           true if the bulk interface below may be used
+ *   KERNEL_PEEK_CHARS(p, lenp)   view the pending input chars
+ *   KERNEL_SKIP_CHARS(p, len)    consume input chars, after the above
+ *   KERNEL_PUT_CHARS(p, s, len)  append a run of chars to the current field
+ *
+ * The macros may use the delimiter and quote of the kernel, as delim and
+ * quote. The compiler then inlines the callbacks, and csv_parse_kernel()
+ * runs a copy of the parser with constant delimiter and quote for the
+ * usual dialects, quoted or not. Other dialects use csv_parse().
+ *
+ * Only csv_parser.c defines CSV_KERNEL_GENERIC, to build csv_parse()
+ * itself on top of the function pointers.
+ */
+
+#ifndef CSV_KERNEL_H__
+#define CSV_KERNEL_H__
+
+#include "csv_parser.h"
+#include "csv_scan.h"
+
+#if defined(__GNUC__)
+#define CSV_KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define CSV_KERNEL_INLINE static inline
+#endif
+
+/* Parser states */
+#define BEFORE_FIELD           0
+#define IN_QUOTED_FIELD        1
+#define AFTER_QUOTE            2
+#define IN_UNQUOTED_FIELD      3
+#define AFTER_FIELD            4
+#define AFTER_DELIM            5
+
+
+/*  kernel_put_run --- move a run of ordinary chars to the current field at once */
+CSV_KERNEL_INLINE void
+kernel_put_run(csv_parser_p p, unsigned char delim, unsigned char quote) {
+    const unsigned char *s;
+    size_t len, run;
+
+    while ((s = KERNEL_PEEK_CHARS(p, &len)) != NULL && len > 0) {
+        run = csv_scan(s, len, delim, quote);
+        if (run > 0) {
+            KERNEL_PUT_CHARS(p, s, run);
+            KERNEL_SKIP_CHARS(p, run);
+        }
+        if (run < len) break;
+    }
+}
+
+/*  csv_kernel --- parse a csv record with the given delimiter and quote */
+CSV_KERNEL_INLINE void
+csv_kernel(csv_parser_p p, unsigned char delim, unsigned char quote) {
+    int state = BEFORE_FIELD;  /* Current parser state */
+    int c = KERNEL_NEXT_CHAR(p);    /* The character we are currently processing */
+
+    /* Process input characters */
+    while (c) {
+        switch (state) {
+          case AFTER_DELIM:
+          case BEFORE_FIELD:
+            if (c==delim) {
+                KERNEL_BEGIN_FIELD(p);
+                KERNEL_END_FIELD(p);
+                state = AFTER_DELIM;
+            } else if (c==CSV_LF) {
+                c = CSV_NULL;
+            } else if (c==quote) {
+                KERNEL_BEGIN_FIELD(p);
+                state = IN_QUOTED_FIELD;
+            } else {
+                KERNEL_BEGIN_FIELD(p);
+                KERNEL_PUT_CHAR(p, c);
+                state = IN_UNQUOTED_FIELD;
+            }
+            break;
+          case IN_QUOTED_FIELD:
+            if (c==quote) {
+                state = AFTER_QUOTE;
+            } else {
+                KERNEL_PUT_CHAR(p, c);
+            }
+            break;
+          case AFTER_QUOTE:
+            if (c==quote) {
+                KERNEL_PUT_CHAR(p, c);
+                state = IN_QUOTED_FIELD;
+            } else if (c==delim) {
+                KERNEL_END_FIELD(p);
+                state = AFTER_DELIM;
+            } else if (c==CSV_LF) {
+                KERNEL_END_FIELD(p);
+                state = AFTER_FIELD;
+                c = CSV_NULL;
+            } else {
+                KERNEL_ERROR(p, _("Unexpected character"));
+                KERNEL_PUT_CHAR(p, quote);
+                KERNEL_PUT_CHAR(p, c);
+                state = IN_UNQUOTED_FIELD;
+            }
+            break;
+          case IN_UNQUOTED_FIELD:
+            if (c==delim) {
+                KERNEL_END_FIELD(p);
+                state = AFTER_DELIM;
+            } else if (c==CSV_LF) {
+                KERNEL_END_FIELD(p);
+                state = AFTER_FIELD;
+                c = CSV_NULL;
+            } else if (c==quote) {
+                KERNEL_ERROR(p, _("Unexpected quote"));
+                KERNEL_PUT_CHAR(p, c);
+            } else {
+                KERNEL_PUT_CHAR(p, c);
+            }
+            break;
+          default:
+            break;
+        }
+        if (c) {
+            if (KERNEL_HAS_RUNS(p) && (state == IN_QUOTED_FIELD || state == IN_UNQUOTED_FIELD))
+                kernel_put_run(p, delim, quote);
+            c = KERNEL_NEXT_CHAR(p);
+        }
+    }
+
+    /* Finalize the record */
+    switch (state) {
+      case BEFORE_FIELD:
+      case AFTER_FIELD:
+        break;
+      case IN_QUOTED_FIELD:
+        KERNEL_ERROR(p, _("Missing closing quote"));
+      case AFTER_QUOTE:
+      case IN_UNQUOTED_FIELD:
+        KERNEL_END_FIELD(p);
+        break;
+      case AFTER_DELIM:
+        KERNEL_BEGIN_FIELD(p);
+        KERNEL_END_FIELD(p);
+        break;
+      default:
+        break;
+    }
+}
+
+#ifndef CSV_KERNEL_GENERIC
+/*  csv_parse_kernel --- parse a csv record with a copy of the parser
+ *  made for the dialect, or with csv_parse() if there is none */
+static void
+csv_parse_kernel(csv_parser_p p) {
+    if (p->quote_char == CSV_QUOTE) {
+        switch (p->delim_char) {
+          case CSV_COMMA:
+            csv_kernel(p, CSV_COMMA, CSV_QUOTE);
+            return;
+          case CSV_SEMICOLON:
+            csv_kernel(p, CSV_SEMICOLON, CSV_QUOTE);
+            return;
+          case CSV_TAB:
+            csv_kernel(p, CSV_TAB, CSV_QUOTE);
+            return;
+        }
+    } else if (p->quote_char == CSV_NULL) {
+        /* no quotes: the compiler drops the quote states */
+        switch (p->delim_char) {
+          case CSV_TAB:
+            csv_kernel(p, CSV_TAB, CSV_NULL);
+            return;
+          case CSV_PIPE:
+            csv_kernel(p, CSV_PIPE, CSV_NULL);
+            return;
+        }
+    }
+    csv_parse(p);
+}
+#endif
+
+#endif
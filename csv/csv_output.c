@@ -0,0 +1,187 @@
+/*
+ * csv_output.c - Functions to write awk output records as csv records.
+ */
+
+/*
+ * Copyright (C) 2018 the Free Software Foundation, Inc.
+ *
+ * This file is part of gawk-csv, the GAWK extension for handling CSV data.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "common_aux.h"
+
+#include "strbuf.h"
+#include "csv_scan.h"
+#include "csv_output.h"
+
+/* find --- position of the first occurrence of sep in s, or len */
+static size_t find(const char *s, size_t len, const char *sep, size_t seplen) {
+    const char *p = s;
+    const char *end = s + len;
+
+    if (seplen == 0) return len;
+    while (p + seplen <= end && (p = memchr(p, sep[0], end - p - seplen + 1)) != NULL) {
+        if (memcmp(p, sep, seplen) == 0) return p - s;
+        p++;
+    }
+    return len;
+}
+
+/* put_field --- append a field to the CSV record, quoted if necessary */
+static void put_field(csv_writer_p w, const char *s, size_t len) {
+    strbuf_p out = &(*w).csv_record;
+    const char *q;
+
+    /* no delimiter, quote or newline: as is */
+    if (csv_scan((const unsigned char *) s, len, w->comma, w->quote) == len) {
+        strbuf_put_chars(out, s, len);
+        return;
+    }
+    strbuf_put_char(out, w->quote);
+    while ((q = memchr(s, w->quote, len)) != NULL) {
+        strbuf_put_chars(out, s, q - s + 1);
+        strbuf_put_char(out, w->quote);    /* double the quote */
+        len -= q - s + 1;
+        s = q + 1;
+    }
+    strbuf_put_chars(out, s, len);
+    strbuf_put_char(out, w->quote);
+}
+
+/* is_sep --- true if a write is exactly the separator sep */
+static int is_sep(const char *s, size_t len, const char *sep, size_t seplen) {
+    return seplen > 0 && len == seplen && memcmp(s, sep, seplen) == 0;
+}
+
+/* add_field --- append a field to the pending CSV record */
+static void add_field(csv_writer_p w, const char *s, size_t len) {
+    if (w->nfields++ > 0) strbuf_put_char(&(*w).csv_record, w->comma);
+    put_field(w, s, len);
+}
+
+/* add_text --- append output written at once, split into fields at OFS */
+static void add_text(csv_writer_p w, const char *s, size_t len) {
+    size_t k;
+
+    for (;;) {
+        k = find(s, len, w->ofs, w->ofs_len);
+        add_field(w, s, k);
+        if (k == len) break;
+        s += k + w->ofs_len;
+        len -= k + w->ofs_len;
+    }
+}
+
+/* put_record --- write the pending CSV record */
+static int put_record(csv_writer_p w, int with_ors) {
+    size_t len;
+
+    if (with_ors) strbuf_put_chars(&(*w).csv_record, w->ors, w->ors_len);
+    len = w->csv_record.length;
+    strbuf_start(&(*w).csv_record);
+    w->nfields = 0;
+    return fwrite(w->csv_record.str, 1, len, w->fp) == len;
+}
+
+/* put_printf --- write the records ended by ORS in the pending printf output */
+static int put_printf(csv_writer_p w) {
+    strbuf_p rec = &(*w).awk_record;
+    size_t len = rec->length;
+    size_t done = 0;
+    size_t k;
+
+    while ((k = find(rec->str + done, len - done, w->ors, w->ors_len)) < len - done) {
+        add_text(w, rec->str + done, k);
+        if (!put_record(w, 1)) return 0;
+        done += k + w->ors_len;
+    }
+    if (done > 0) {
+        memmove(rec->str, rec->str + done, len - done);
+        rec->length = len - done;
+    }
+    return 1;
+}
+
+/* Create a csv output writer */
+void csv_writer_init(csv_writer_p writer, FILE *fp, char csvcomma, char csvquote,
+                     const char *ofs, int ofslen, const char *ors, int orslen) {
+    writer->fp = fp;
+    writer->comma = csvcomma;
+    writer->quote = csvquote;
+    emalloc(writer->ofs, char *, ofslen + 1, "csv_writer_init");
+    memcpy(writer->ofs, ofs, ofslen);
+    writer->ofs_len = ofslen;
+    emalloc(writer->ors, char *, orslen + 1, "csv_writer_init");
+    memcpy(writer->ors, ors, orslen);
+    writer->ors_len = orslen;
+    strbuf_init(&(*writer).awk_record);
+    strbuf_init(&(*writer).csv_record);
+    writer->nfields = 0;
+    writer->after_data = 0;
+}
+
+/* Write awk output, return len or 0 on failure.
+ * gawk writes each field, OFS and ORS of a print statement separately,
+ * even empty fields, so a separator always follows data. A write that
+ * does not follow data is data, even if it looks like OFS or ORS. After
+ * data, a write that is exactly OFS ends a field, and one that is
+ * exactly ORS ends the record. Only the output of a single write, like print $0, is split at
+ * OFS. Two writes of data in a row mean that the first one was a printf:
+ * its records are ended by ORS within it. */
+size_t csv_write(csv_writer_p writer, const char *buf, size_t len) {
+    strbuf_p rec = &(*writer).awk_record;
+
+    if (!writer->after_data) {
+        strbuf_put_chars(rec, buf, len);
+        writer->after_data = 1;
+    } else if (is_sep(buf, len, writer->ofs, writer->ofs_len)) {
+        add_field(writer, rec->str, rec->length);
+        strbuf_start(rec);
+        writer->after_data = 0;
+    } else if (is_sep(buf, len, writer->ors, writer->ors_len)) {
+        if (writer->nfields == 0)
+            add_text(writer, rec->str, rec->length);
+        else
+            add_field(writer, rec->str, rec->length);
+        strbuf_start(rec);
+        writer->after_data = 0;
+        if (!put_record(writer, 1)) return 0;
+    } else {
+        if (writer->nfields == 0 && !put_printf(writer)) return 0;
+        strbuf_put_chars(rec, buf, len);
+        writer->after_data = 1;
+    }
+    return len;
+}
+
+/* Write the complete records of pending printf output, return 0 on failure */
+int csv_writer_flush(csv_writer_p writer) {
+    if (writer->after_data && writer->nfields == 0) {
+        if (!put_printf(writer)) return 0;
+        /* all written: the next write starts a record */
+        if (writer->awk_record.length == 0) writer->after_data = 0;
+    }
+    return 1;
+}
+
+/* Write the pending output and destroy the writer, without closing the file */
+int csv_writer_close(csv_writer_p writer) {
+    int ok = csv_writer_flush(writer);
+
+    if (ok && (writer->awk_record.length > 0 || writer->nfields > 0)) {
+        if (writer->nfields == 0)
+            add_text(writer, writer->awk_record.str, writer->awk_record.length);
+        else
+            add_field(writer, writer->awk_record.str, writer->awk_record.length);
+        ok = put_record(writer, 0);
+    }
+    gawk_free(writer->ofs);
+    gawk_free(writer->ors);
+    strbuf_free(&(*writer).awk_record);
+    strbuf_free(&(*writer).csv_record);
+    return ok ? 0 : EOF;
+}
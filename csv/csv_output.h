@@ -0,0 +1,41 @@
+#ifndef CSV_OUTPUT_H__
+#define CSV_OUTPUT_H__
+
+//#include "common_aux.h"
+
+#include "strbuf.h"
+
+#ifndef CSV_OUTPUT_BUFSIZE
+#define CSV_OUTPUT_BUFSIZE 262144  /* stdio buffer of the output file */
+#endif
+
+typedef struct csv_writer {
+    FILE *fp;               /* output file */
+    char comma;             /* CSV field delimiter */
+    char quote;             /* CSV quoting character */
+    char *ofs;              /* field separator of the awk output */
+    int ofs_len;            /* length of the above */
+    char *ors;              /* record separator of the awk output */
+    int ors_len;            /* length of the above */
+    strbuf_t awk_record;    /* pending awk output, not yet a field */
+    strbuf_t csv_record;    /* pending CSV record, fields formatted so far */
+    int nfields;            /* number of fields in csv_record */
+    int after_data;         /* last write was data, not OFS or ORS */
+} csv_writer_t;
+
+typedef struct csv_writer * csv_writer_p;
+
+/* Create a csv output writer */
+void csv_writer_init(csv_writer_p writer, FILE *fp, char csvcomma, char csvquote,
+                     const char *ofs, int ofslen, const char *ors, int orslen);
+
+/* Write awk output, return len or 0 on failure */
+size_t csv_write(csv_writer_p writer, const char *buf, size_t len);
+
+/* Write the complete records of pending printf output, return 0 on failure */
+int csv_writer_flush(csv_writer_p writer);
+
+/* Write the pending output and destroy the writer, without closing the file */
+int csv_writer_close(csv_writer_p writer);
+
+#endif
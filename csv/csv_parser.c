@@ -16,105 +16,24 @@
 
 #include "csv_parser.h"
 
-/* Parser states */
-#define BEFORE_FIELD           0
-#define IN_QUOTED_FIELD        1
-#define AFTER_QUOTE            2
-#define IN_UNQUOTED_FIELD      3
-#define AFTER_FIELD            4
-#define AFTER_DELIM            5
+/* csv_parse is the kernel, calling the consumer through its function pointers */
+#define KERNEL_NEXT_CHAR(p)          ((p)->next_char(p))
+#define KERNEL_BEGIN_FIELD(p)        ((p)->begin_field(p))
+#define KERNEL_END_FIELD(p)          ((p)->end_field(p))
+#define KERNEL_PUT_CHAR(p, c)        ((p)->put_char(p, c))
+#define KERNEL_ERROR(p, msg)         ((p)->error(p, msg))
+#define KERNEL_HAS_RUNS(p)           ((p)->peek_chars != NULL)
+#define KERNEL_PEEK_CHARS(p, lenp)   ((p)->peek_chars(p, lenp))
+#define KERNEL_SKIP_CHARS(p, len)    ((p)->skip_chars(p, len))
+#define KERNEL_PUT_CHARS(p, s, len)  ((p)->put_chars(p, s, len))
+
+#define CSV_KERNEL_GENERIC
+#include "csv_kernel.h"
 
 
 /*  csv_parse --- parse a csv record
  *  from a generic source stream into a generic output structure */
 void
 csv_parse(csv_parser_p p) {
-    int state = BEFORE_FIELD;  /* Current parser state */
-    int c = p->next_char();    /* The character we are currently processing */
-
-    /* Process input characters */
-    while (c) {
-        switch (state) {
-          case AFTER_DELIM:
-          case BEFORE_FIELD:
-            if (c==p->delim_char) {
-                p->begin_field();
-                p->end_field();
-                state = AFTER_DELIM;
-            } else if (c==CSV_LF) {
-                c = CSV_NULL;
-            } else if (c==p->quote_char) {
-                p->begin_field();
-                state = IN_QUOTED_FIELD;
-            } else {
-                p->begin_field();
-                p->put_char(c);
-                state = IN_UNQUOTED_FIELD;
-            }
-            break;
-          case IN_QUOTED_FIELD:
-            if (c==p->quote_char) {
-                state = AFTER_QUOTE;
-            } else {
-                p->put_char(c);
-            }
-            break;
-          case AFTER_QUOTE:
-            if (c==p->quote_char) {
-                p->put_char(c);
-                state = IN_QUOTED_FIELD;
-            } else if (c==p->delim_char) {
-                p->end_field();
-                state = AFTER_DELIM;
-            } else if (c==CSV_LF) {
-                p->end_field();
-                state = AFTER_FIELD;
-                c = CSV_NULL;
-            } else {
-                p->error(_("Unexpected character"));
-                p->put_char(p->quote_char);
-                p->put_char(c);
-                state = IN_UNQUOTED_FIELD;
-            }
-            break;
-          case IN_UNQUOTED_FIELD:
-            if (c==p->delim_char) {
-                p->end_field();
-                state = AFTER_DELIM;
-            } else if (c==CSV_LF) {
-                p->end_field();
-                state = AFTER_FIELD;
-                c = CSV_NULL;
-            } else if (c==p->quote_char) {
-                p->error(_("Unexpected quote"));
-                p->put_char(c);
-            } else {
-                p->put_char(c);
-            }
-            break;
-          default:
-            break;
-        }
-        if (c) c = p->next_char();
-    }
-    
-    /* Finalize the record */
-    switch (state) {
-      case BEFORE_FIELD:
-      case AFTER_FIELD:
-        break;
-      case IN_QUOTED_FIELD:
-        p->error(_("Missing closing quote"));
-      case AFTER_QUOTE:
-      case IN_UNQUOTED_FIELD:
-        p->end_field();
-        break;
-      case AFTER_DELIM:
-        p->begin_field();
-        p->end_field();
-        break;
-      default:
-        break;
-    }    
-
+    csv_kernel(p, p->delim_char, p->quote_char);
 }
@@ -1,6 +1,8 @@
 #ifndef CSV_PARSER_H__
 #define CSV_PARSER_H__
 
+#include <stddef.h>
+
 /* Parser options */
 #define CSV_TRIM 1                 /* discard unquoted space */
 #define CSV_IGNORE_EXTRA_SPACE 2   /* discard unquoted space around quoted fields */
@@ -12,23 +14,31 @@
 #define CSV_CR     0x0d
 #define CSV_LF     0x0a
 #define CSV_COMMA  0x2c
+#define CSV_SEMICOLON 0x3b
+#define CSV_PIPE   0x7c
 #define CSV_QUOTE  0x22
 #define CSV_NULL   0x00
 
 /* CSV parser descriptor */
 /* Uses generic functions for input and output,
-   so it can be used in a variety of contexts */
+   so it can be used in a variety of contexts.
+   Every function gets the parser itself, so that a consumer
+   can keep its state next to it, instead of in static variables */
 typedef struct csv_parser {
     unsigned char delim_char;       /* actual delimitar (comma or other) */
     unsigned char quote_char;       /* actual quote char (double quote or other) */
     unsigned char options;          /* packed set of flags */
-    unsigned char (*next_char)();   /* get the next input char */
-    void (*begin_field)();          /* start a new output field */
-    void (*end_field)();            /* end the current output field */
-    void (*mark_field)();           /* mark the current output field position */
-    void (*backspace_field)();      /* discard data after the current output field mark */
-    void (*put_char)(unsigned char); /* append a character to the current output field */
-    void (*error)(const char*);     /* report error message */
+    unsigned char (*next_char)(struct csv_parser*);   /* get the next input char */
+    void (*begin_field)(struct csv_parser*);          /* start a new output field */
+    void (*end_field)(struct csv_parser*);            /* end the current output field */
+    void (*mark_field)(struct csv_parser*);           /* mark the current output field position */
+    void (*backspace_field)(struct csv_parser*);      /* discard data after the current output field mark */
+    void (*put_char)(struct csv_parser*, unsigned char); /* append a character to the current output field */
+    void (*error)(struct csv_parser*, const char*);   /* report error message */
+    /* Optional bulk interface, may be NULL */
+    const unsigned char *(*peek_chars)(struct csv_parser*, size_t*); /* view the pending input chars */
+    void (*skip_chars)(struct csv_parser*, size_t);   /* consume input chars, after peek_chars */
+    void (*put_chars)(struct csv_parser*, const unsigned char*, size_t); /* append a run of chars to the current output field */
 } csv_parser_t;
 
 typedef struct csv_parser * csv_parser_p;
@@ -0,0 +1,142 @@
+/*
+ * csv_scan.c - Find the next special char of csv data, many bytes at a time.
+ */
+
+/*
+ * Copyright (C) 2018 the Free Software Foundation, Inc.
+ *
+ * This file is part of gawk-csv, the GAWK extension for handling CSV data.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include "common_aux.h"
+
+#include "csv_parser.h"
+#include "csv_scan.h"
+
+/* SSE2 is always there on x86-64. AVX2 is checked at run time */
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define CSV_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef size_t (*scan_func_t)(const unsigned char *, size_t, unsigned char, unsigned char);
+
+static size_t scan_init(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote);
+
+static scan_func_t scan_impl = scan_init;
+
+/* scan_scalar --- portable version, one char at a time */
+static size_t
+scan_scalar(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote) {
+    size_t k;
+    for (k = 0; k < len; k++) {
+        unsigned char c = s[k];
+        if (c == delim || c == quote || c == CSV_LF || c == CSV_CR || c == CSV_NULL)
+            break;
+    }
+    return k;
+}
+
+#ifdef CSV_SCAN_X86
+
+/* scan_sse2 --- 16 chars at a time */
+static size_t
+scan_sse2(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote) {
+    const __m128i vdelim = _mm_set1_epi8((char) delim);
+    const __m128i vquote = _mm_set1_epi8((char) quote);
+    const __m128i vlf = _mm_set1_epi8(CSV_LF);
+    const __m128i vcr = _mm_set1_epi8(CSV_CR);
+    const __m128i vnul = _mm_setzero_si128();
+    size_t k = 0;
+
+    for (; k + 16 <= len; k += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + k));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, vdelim), _mm_cmpeq_epi8(v, vquote)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, vlf), _mm_cmpeq_epi8(v, vcr)),
+                         _mm_cmpeq_epi8(v, vnul)));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return k + __builtin_ctz(mask);
+    }
+    return k + scan_scalar(s + k, len - k, delim, quote);
+}
+
+/* scan_avx2 --- 32 chars at a time */
+__attribute__((target("avx2")))
+static size_t
+scan_avx2(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote) {
+    const __m256i vdelim = _mm256_set1_epi8((char) delim);
+    const __m256i vquote = _mm256_set1_epi8((char) quote);
+    const __m256i vlf = _mm256_set1_epi8(CSV_LF);
+    const __m256i vcr = _mm256_set1_epi8(CSV_CR);
+    const __m256i vnul = _mm256_setzero_si256();
+    size_t k = 0;
+
+    for (; k + 32 <= len; k += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (s + k));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, vdelim), _mm256_cmpeq_epi8(v, vquote)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, vlf), _mm256_cmpeq_epi8(v, vcr)),
+                            _mm256_cmpeq_epi8(v, vnul)));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(m);
+        if (mask)
+            return k + __builtin_ctz(mask);
+    }
+    /* the tail is scanned here too: calling the non-VEX SSE2 code
+       with dirty upper registers is very slow on some CPUs */
+    if (k + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + k));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(vdelim)),
+                         _mm_cmpeq_epi8(v, _mm256_castsi256_si128(vquote))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(vlf)),
+                                      _mm_cmpeq_epi8(v, _mm256_castsi256_si128(vcr))),
+                         _mm_cmpeq_epi8(v, _mm256_castsi256_si128(vnul))));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return k + __builtin_ctz(mask);
+        k += 16;
+    }
+    for (; k < len; k++) {
+        unsigned char c = s[k];
+        if (c == delim || c == quote || c == CSV_LF || c == CSV_CR || c == CSV_NULL)
+            break;
+    }
+    return k;
+}
+
+#endif /* CSV_SCAN_X86 */
+
+/* scan_init --- select the best implementation on first use */
+static size_t
+scan_init(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote) {
+#ifdef CSV_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        scan_impl = scan_avx2;
+    else
+        scan_impl = scan_sse2;
+#else
+    scan_impl = scan_scalar;
+#endif
+    return scan_impl(s, len, delim, quote);
+}
+
+/*  csv_scan_init --- select the implementation now, before starting threads */
+void
+csv_scan_init(void) {
+    unsigned char c = CSV_NULL;
+    if (scan_impl == scan_init) (void) scan_init(&c, 1, CSV_COMMA, CSV_QUOTE);
+}
+
+/*  csv_scan --- length of the leading run of ordinary chars.
+ *  Stops at the delimiter, the quote, CR, LF or NUL */
+size_t
+csv_scan(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote) {
+    return scan_impl(s, len, delim, quote);
+}
@@ -0,0 +1,10 @@
+#ifndef CSV_SCAN_H__
+#define CSV_SCAN_H__
+
+#include <stddef.h>
+
+/* Function prototypes */
+void csv_scan_init(void);
+size_t csv_scan(const unsigned char *s, size_t len, unsigned char delim, unsigned char quote);
+
+#endif
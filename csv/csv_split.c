@@ -20,19 +20,29 @@
 
 static char* csv_record;    /* pointer to the csv input string */
 static int pos;             /* input offset */
-static struct strbuf sbuf;  /* buffer to build a field */
+static int reclen;          /* length of the csv input string */
+static struct strbuf sbuf;  /* buffer to build a field, kept between calls */
 static int fieldcount = 0;  /* number of completed fields */
 static awk_array_t oaf;     /* output array of fields */
 
-static unsigned char next_char() {  /* get the next input char */
+static unsigned char next_char(csv_parser_p p __UNUSED) {  /* get the next input char */
     return csv_record[pos++];
 }
 
-static void begin_field() {         /* start a new output field */
+static const unsigned char *peek_chars(csv_parser_p p __UNUSED, size_t *len) {  /* view the pending input chars */
+    *len = reclen - pos;
+    return (const unsigned char *) &csv_record[pos];
+}
+
+static void skip_chars(csv_parser_p p __UNUSED, size_t len) {  /* consume input chars, after peek_chars */
+    pos += len;
+}
+
+static void begin_field(csv_parser_p p __UNUSED) {         /* start a new output field */
     strbuf_start(&sbuf);
 }
 
-static void end_field() {           /* end of the current output field */
+static void end_field(csv_parser_p p __UNUSED) {           /* end of the current output field */
     awk_value_t index, value;
     ++fieldcount;
     (void) make_number(fieldcount, &index);
@@ -42,19 +52,23 @@ static void end_field() {           /* end of the current output field */
     }
 }
 
-static void mark_field() {          /* mark the current output field position */
+static void mark_field(csv_parser_p p __UNUSED) {          /* mark the current output field position */
     /* RESERVED FOR FUTURE USE */
 }
 
-static void backspace_field() {     /* discard data after the current output field mark */
+static void backspace_field(csv_parser_p p __UNUSED) {     /* discard data after the current output field mark */
     /* RESERVED FOR FUTURE USE */
 }
 
-static void put_char(unsigned char c) { /* append a character to the current output field */
+static void put_char(csv_parser_p p __UNUSED, unsigned char c) { /* append a character to the current output field */
     strbuf_put_char(&sbuf, c);
 }
 
-static void error(const char* msg) { /* report error message */
+static void put_chars(csv_parser_p p __UNUSED, const unsigned char *s, size_t len) { /* append a run of chars to the current output field */
+    strbuf_put_chars(&sbuf, (const char *) s, len);
+}
+
+static void error(csv_parser_p p __UNUSED, const char* msg) { /* report error message */
     const int WIDTH = 65;
     const int TAIL = 10;
     const int DOTS = 3;
@@ -86,11 +100,25 @@ static void error(const char* msg) { /* report error message */
     nonfatal(ext_id, "csvsplit: %s\n  %s\n  %*c", msg, textline, cursor, '^');
 }
 
+/* The parser kernel, calling the functions above directly */
+#define KERNEL_NEXT_CHAR(p)          next_char(p)
+#define KERNEL_BEGIN_FIELD(p)        begin_field(p)
+#define KERNEL_END_FIELD(p)          end_field(p)
+#define KERNEL_PUT_CHAR(p, c)        put_char(p, c)
+#define KERNEL_ERROR(p, msg)         error(p, msg)
+#define KERNEL_HAS_RUNS(p)           1
+#define KERNEL_PEEK_CHARS(p, lenp)   peek_chars(p, lenp)
+#define KERNEL_SKIP_CHARS(p, len)    skip_chars(p, len)
+#define KERNEL_PUT_CHARS(p, s, len)  put_chars(p, s, len)
+
+#include "csv_kernel.h"
+
 /* csv_split_record --- split a csv record into an array of fields */
 int
 csv_split_record(const char* s, awk_array_t af, char comma, char quote, char options) {
     csv_record = s;
     pos = 0;
+    reclen = strlen(s);
     fieldcount = 0;
     oaf = af;
 
@@ -105,8 +133,11 @@ csv_split_record(const char* s, awk_array_t af, char comma, char quote, char opt
     p.backspace_field = &backspace_field;
     p.put_char = &put_char;
     p.error = &error;
+    p.peek_chars = &peek_chars;
+    p.skip_chars = &skip_chars;
+    p.put_chars = &put_chars;
 
-    strbuf_init(&sbuf);
-    csv_parse(&p);
+    if (sbuf.str == NULL) strbuf_init(&sbuf);
+    csv_parse_kernel(&p);
     return fieldcount;
 }
@@ -0,0 +1,469 @@
+/*
+ * csv_threads.c - Parse a mapped csv file with several threads.
+ */
+
+/*
+ * Copyright (C) 2018 the Free Software Foundation, Inc.
+ *
+ * This file is part of gawk-csv, the GAWK extension for handling CSV data.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/*
+ * The file is split into byte ranges (chunks). Each worker thread guesses
+ * where the first record of its chunk begins, and parses the records that
+ * begin inside the chunk with its own csv reader. The gawk thread delivers
+ * the records in order. A chunk is valid if it begins exactly where the
+ * last record of the previous chunk ends. Otherwise the guess was wrong,
+ * e.g. it fell inside a quoted field with newlines, and the gawk thread
+ * parses the chunk again from the right place. So the result is always
+ * the same as that of a single reader.
+ *
+ * The gawk API may only be used from the gawk thread. Workers keep
+ * their error messages, to be reported along with the record.
+ */
+
+#include "common_aux.h"
+
+#include "strbuf.h"
+#include "csv_parser.h"
+#include "csv_scan.h"
+#include "csv_input.h"
+#include "csv_threads.h"
+#include "awk_fieldwidth_info.h"
+
+#ifdef CSV_USE_THREADS
+
+#include <pthread.h>
+
+#define GUESS_WINDOW 65536          /* bytes examined to guess the quote state */
+
+/* Chunk states */
+#define CHUNK_FREE      0
+#define CHUNK_BUSY      1
+#define CHUNK_DONE      2
+
+/* A parsed record, kept until delivered */
+struct chunk_record {
+    size_t awk_off;         /* awk record, in data or in the mapped file */
+    size_t csv_off;         /* CSV record, in data or in the mapped file */
+    int awk_len;            /* length of the awk record, -1 = end of input */
+    int csv_len;            /* length of the CSV record */
+    int in_map;             /* offsets refer to the mapped file */
+    size_t field_off;       /* first field position in fields */
+    size_t nf;              /* number of field positions */
+    int err_off;            /* error messages in errors */
+    int err_len;            /* length of the above */
+    char rt[3];             /* record terminator */
+    int rt_len;             /* length of the record terminator */
+};
+
+/* A range of the input file and its records */
+struct csv_chunk {
+    size_t index;           /* chunk number, (size_t)-1 = none yet */
+    int state;              /* CHUNK_FREE, CHUNK_BUSY or CHUNK_DONE */
+    size_t start;           /* first record, as guessed */
+    size_t end;             /* records begin before this offset */
+    size_t stop;            /* end of the last record */
+    strbuf_t data;          /* copied awk and CSV records */
+    strbuf_t errors;        /* '\0' terminated error messages */
+    csv_stats_t stats;      /* counters of the parsing */
+    struct chunk_record *recs;
+    size_t nrecs;
+    size_t max_recs;
+#if gawk_api_major_version >= 2
+    struct awk_field_info *fields;
+    size_t nfields;
+    size_t max_fields;
+#endif
+};
+
+struct csv_worker {
+    csv_pool_p pool;
+    pthread_t thread;
+    struct csv_reader reader;   /* private reader on the shared mapping */
+};
+
+struct csv_pool {
+    const unsigned char *map;   /* the mapped file */
+    size_t size;                /* its size */
+    size_t base;                /* offset of the first record */
+    size_t chunk_size;
+    size_t nchunks;
+    unsigned char delim;
+    unsigned char quote;
+
+    struct csv_chunk *slots;    /* bounded queue of chunks, chunk k in slot k % nslots */
+    size_t nslots;
+    struct csv_worker *workers;
+    int nthreads;
+    struct csv_reader spare;    /* for parsing again in the gawk thread */
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;     /* a slot has been released */
+    pthread_cond_t done_cv;     /* a chunk has been parsed */
+    size_t next;                /* next chunk to give to a worker */
+    size_t cur;                 /* chunk being delivered */
+    int shutdown;
+
+    /* only used by the gawk thread */
+    int ready;                  /* the current chunk has been checked */
+    size_t rec;                 /* next record to deliver */
+    size_t prev_stop;           /* end of the last record of the previous chunk */
+    int eof;
+};
+
+
+/*  record_start --- guess where the first record after pos begins.
+ *  A quote next to a delimiter or newline tells whether it opens or closes
+ *  a quoted field, hence the quote state at pos. Then skip to the first
+ *  newline outside quotes. Without quotes, any newline will do */
+static size_t
+record_start(csv_pool_p pool, size_t pos) {
+    const unsigned char *s = pool->map;
+    size_t end = pool->size;
+    size_t limit = (end - pos > GUESS_WINDOW) ? pos + GUESS_WINDOW : end;
+    size_t k;
+    int parity = 0;
+    int inside = 0;     /* quote state at pos, outside unless proven */
+    int quoted = (pool->quote != CSV_NULL);
+
+    for (k = pos; quoted && k < limit; k++) {
+        unsigned char before, after;
+        int sep_before, sep_after;
+
+        if (s[k] != pool->quote) continue;
+        before = (k > 0) ? s[k-1] : CSV_LF;
+        after = (k + 1 < end) ? s[k+1] : CSV_LF;
+        sep_before = (before == pool->delim || before == CSV_LF || before == CSV_CR);
+        sep_after = (after == pool->delim || after == CSV_LF || after == CSV_CR);
+        if (sep_before && !sep_after && after != pool->quote) {
+            inside = parity;        /* opening quote: outside before it */
+            break;
+        }
+        if (sep_after && !sep_before && before != pool->quote) {
+            inside = !parity;       /* closing quote: inside before it */
+            break;
+        }
+        parity = !parity;
+    }
+
+    for (k = pos; k < end; k++) {
+        unsigned char c = s[k];
+        if (quoted && c == pool->quote) {
+            inside = !inside;
+        } else if (!inside && (c == CSV_LF || c == CSV_CR)) {
+            k++;
+            if (c == CSV_CR && k < end && s[k] == CSV_LF) k++;
+            return k;
+        }
+    }
+    return end;
+}
+
+/*  chunk_start --- guessed offset of the first record of a chunk */
+static size_t
+chunk_start(csv_pool_p pool, size_t index) {
+    if (index == 0) return pool->base;
+    if (index >= pool->nchunks) return pool->size;
+    return record_start(pool, pool->base + index * pool->chunk_size);
+}
+
+/*  parse_chunk --- parse the records beginning in [start, end) */
+static void
+parse_chunk(csv_pool_p pool, csv_reader_p r, struct csv_chunk *c, size_t start, size_t end) {
+    const char *map = (const char *) pool->map;
+    struct chunk_record *rec;
+    int len;
+
+    c->start = start;
+    c->end = end;
+    c->nrecs = 0;
+    strbuf_start(&(*c).data);
+    strbuf_start(&(*c).errors);
+#if gawk_api_major_version >= 2
+    c->nfields = 0;
+#endif
+    r->errors = &(*c).errors;
+    r->buf_pos = start;
+    memset(&(*r).stats, 0, sizeof(r->stats));
+
+    while (r->buf_pos < end) {
+        int err_mark = c->errors.length;
+
+        len = csv_read(r);
+        if (c->nrecs >= c->max_recs) {
+            c->max_recs = c->max_recs ? 2 * c->max_recs : 1024;
+            erealloc(c->recs, struct chunk_record *, c->max_recs * sizeof(*c->recs), "parse_chunk");
+        }
+        rec = &(*c).recs[c->nrecs++];
+        rec->err_off = err_mark;
+        rec->err_len = c->errors.length - err_mark;
+        rec->awk_len = len;
+        rec->nf = 0;
+        if (len < 0) break;     /* gawk will not ask for more */
+
+        memcpy(rec->rt, r->rt, r->rt_len);
+        rec->rt_len = r->rt_len;
+        rec->csv_len = r->csv_out_len;
+        if (r->awk_out >= map && r->awk_out < map + pool->size) {
+            rec->in_map = 1;
+            rec->awk_off = r->awk_out - map;
+            rec->csv_off = r->csv_out - map;
+        } else {
+            rec->in_map = 0;
+            rec->awk_off = c->data.length;
+            strbuf_put_chars(&(*c).data, r->awk_out, len);
+            rec->csv_off = c->data.length;
+            strbuf_put_chars(&(*c).data, r->csv_out, r->csv_out_len);
+        }
+#if gawk_api_major_version >= 2
+        rec->field_off = c->nfields;
+        rec->nf = r->csv_fields->nf;
+        if (rec->nf > 0) {
+            if (c->nfields + rec->nf > c->max_fields) {
+                while (c->nfields + rec->nf > c->max_fields)
+                    c->max_fields = c->max_fields ? 2 * c->max_fields : 16384;
+                erealloc(c->fields, struct awk_field_info *, c->max_fields * sizeof(*c->fields), "parse_chunk");
+            }
+            memcpy(&(*c).fields[c->nfields], r->csv_fields->fields, rec->nf * sizeof(*c->fields));
+            c->nfields += rec->nf;
+        }
+#endif
+    }
+    c->stop = r->buf_pos;
+    c->stats = r->stats;
+    r->errors = NULL;
+}
+
+/*  worker --- thread body: parse chunks while there are free slots */
+static void *
+worker(void *arg) {
+    struct csv_worker *w = arg;
+    csv_pool_p pool = w->pool;
+    struct csv_chunk *c;
+    size_t index;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->next < pool->nchunks
+               && pool->next >= pool->cur + pool->nslots)
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        if (pool->shutdown || pool->next >= pool->nchunks) break;
+        index = pool->next++;
+        c = &pool->slots[index % pool->nslots];
+        c->index = index;
+        c->state = CHUNK_BUSY;
+        pthread_mutex_unlock(&pool->lock);
+
+        parse_chunk(pool, &w->reader, c, chunk_start(pool, index), chunk_start(pool, index + 1));
+
+        pthread_mutex_lock(&pool->lock);
+        c->state = CHUNK_DONE;
+        pthread_cond_broadcast(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*  view_reader --- a reader on the mapping of another one */
+static void
+view_reader(csv_reader_p view, csv_reader_p reader) {
+    csv_reader_init(view, reader->fd, reader->csv_mode,
+                    reader->parser.delim_char, reader->parser.quote_char,
+                    reader->csv_fs, reader->csv_fs_len);
+    gawk_free(view->buffer);
+    view->buffer = reader->buffer;
+    view->buf_len = reader->buf_len;
+    view->mapped = 1;
+    view->columns = reader->columns;
+    view->max_column = reader->max_column;
+}
+
+/*  close_view --- destroy a reader made by view_reader, keeping the mapping */
+static void
+close_view(csv_reader_p view) {
+    view->mapped = 0;
+    view->buffer = NULL;
+    view->columns = NULL;
+    csv_reader_close(view);
+}
+
+#endif /* CSV_USE_THREADS */
+
+
+/*  csv_pool_start --- start parsing the mapped file of reader in nthreads threads.
+ *  Return NULL if not possible or not worth it */
+csv_pool_p
+csv_pool_start(csv_reader_p reader, int nthreads) {
+#ifdef CSV_USE_THREADS
+    csv_pool_p pool;
+    size_t k;
+    int started = 0;
+
+    if (!reader->mapped || nthreads < 2) return NULL;
+    if (nthreads > CSV_MAX_THREADS) nthreads = CSV_MAX_THREADS;
+
+    ezalloc(pool, csv_pool_p, sizeof(*pool), "csv_pool_start");
+    pool->map = (const unsigned char *) reader->buffer;
+    pool->size = reader->buf_len;
+    pool->base = reader->buf_pos;
+    pool->delim = reader->parser.delim_char;
+    pool->quote = reader->parser.quote_char;
+    pool->chunk_size = (pool->size - pool->base) / (8 * nthreads);
+    if (pool->chunk_size < CSV_CHUNK_MIN) pool->chunk_size = CSV_CHUNK_MIN;
+    if (pool->chunk_size > CSV_CHUNK_MAX) pool->chunk_size = CSV_CHUNK_MAX;
+    pool->nchunks = (pool->size - pool->base + pool->chunk_size - 1) / pool->chunk_size;
+    if (pool->nchunks < 2) {
+        gawk_free(pool);
+        return NULL;
+    }
+
+    csv_scan_init();
+    pool->nslots = 2 * nthreads;
+    ezalloc(pool->slots, struct csv_chunk *, pool->nslots * sizeof(*pool->slots), "csv_pool_start");
+    for (k = 0; k < pool->nslots; k++) {
+        pool->slots[k].index = (size_t) -1;
+        pool->slots[k].state = CHUNK_FREE;
+        strbuf_init(&(*pool).slots[k].data);
+        strbuf_init(&(*pool).slots[k].errors);
+    }
+    view_reader(&(*pool).spare, reader);
+    pool->prev_stop = pool->base;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+    ezalloc(pool->workers, struct csv_worker *, nthreads * sizeof(*pool->workers), "csv_pool_start");
+    for (k = 0; k < (size_t) nthreads; k++) {
+        struct csv_worker *w = &(*pool).workers[started];
+        w->pool = pool;
+        view_reader(&(*w).reader, reader);
+        if (pthread_create(&w->thread, NULL, worker, w) != 0) {
+            close_view(&(*w).reader);
+            break;
+        }
+        started++;
+    }
+    pool->nthreads = started;
+    if (started == 0) {
+        csv_pool_stop(pool);
+        return NULL;
+    }
+    return pool;
+#else
+    return NULL;
+#endif
+}
+
+/*  csv_pool_read --- deliver the next record, like csv_read */
+int
+csv_pool_read(csv_pool_p pool, csv_reader_p reader) {
+#ifdef CSV_USE_THREADS
+    struct csv_chunk *c;
+    struct chunk_record *rec;
+    const char *base;
+    int k;
+
+    if (pool->eof) return -1;
+    for (;;) {
+        if (pool->cur >= pool->nchunks) {
+            pool->eof = 1;
+            return -1;
+        }
+        c = &(*pool).slots[pool->cur % pool->nslots];
+        if (!pool->ready) {
+            pthread_mutex_lock(&pool->lock);
+            while (c->index != pool->cur || c->state != CHUNK_DONE)
+                pthread_cond_wait(&pool->done_cv, &pool->lock);
+            pthread_mutex_unlock(&pool->lock);
+            if (c->start != pool->prev_stop) {
+                /* wrong guess: the previous chunk did not end there */
+                parse_chunk(pool, &(*pool).spare, c, pool->prev_stop, c->end);
+            }
+            /* records are counted as they are delivered */
+            reader->stats.bytes += c->stats.bytes;
+            reader->stats.fields += c->stats.fields;
+            reader->stats.quoted += c->stats.quoted;
+            reader->stats.errors += c->stats.errors;
+            pool->ready = 1;
+            pool->rec = 0;
+        }
+        if (pool->rec < c->nrecs) break;
+
+        /* chunk exhausted, give its slot back */
+        pool->prev_stop = c->stop;
+        pool->ready = 0;
+        pthread_mutex_lock(&pool->lock);
+        c->state = CHUNK_FREE;
+        pool->cur++;
+        pthread_cond_broadcast(&pool->work_cv);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    rec = &(*c).recs[pool->rec++];
+    for (k = 0; k < rec->err_len; k += strlen(&(*c).errors.str[rec->err_off + k]) + 1) {
+        nonfatal(ext_id, "%s", &(*c).errors.str[rec->err_off + k]);
+    }
+    if (rec->awk_len < 0) {
+        pool->eof = 1;
+        return -1;
+    }
+
+    base = rec->in_map ? (const char *) pool->map : c->data.str;
+    reader->awk_out = (char *) base + rec->awk_off;
+    reader->csv_out = (char *) base + rec->csv_off;
+    reader->csv_out_len = rec->csv_len;
+    memcpy(reader->rt, rec->rt, rec->rt_len);
+    reader->rt_len = rec->rt_len;
+#if gawk_api_major_version >= 2
+    {
+        size_t f;
+        awk_fieldwidth_info_start(reader->csv_fields);
+        for (f = 0; f < rec->nf; f++) {
+            struct awk_field_info *fi = &(*c).fields[rec->field_off + f];
+            reader->max_fields = awk_fieldwidth_info_add(&(*reader).csv_fields, reader->max_fields, fi->skip, fi->len);
+        }
+    }
+#endif
+    return rec->awk_len;
+#else
+    return -1;
+#endif
+}
+
+/*  csv_pool_stop --- stop the threads and free memory */
+void
+csv_pool_stop(csv_pool_p pool) {
+#ifdef CSV_USE_THREADS
+    size_t k;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+    for (k = 0; k < (size_t) pool->nthreads; k++) {
+        pthread_join(pool->workers[k].thread, NULL);
+        close_view(&(*pool).workers[k].reader);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+
+    for (k = 0; k < pool->nslots; k++) {
+        strbuf_free(&(*pool).slots[k].data);
+        strbuf_free(&(*pool).slots[k].errors);
+        gawk_free(pool->slots[k].recs);
+#if gawk_api_major_version >= 2
+        gawk_free(pool->slots[k].fields);
+#endif
+    }
+    close_view(&(*pool).spare);
+    gawk_free(pool->slots);
+    gawk_free(pool->workers);
+    gawk_free(pool);
+#endif
+}
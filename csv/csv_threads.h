@@ -0,0 +1,23 @@
+#ifndef CSV_THREADS_H__
+#define CSV_THREADS_H__
+
+#include "csv_input.h"
+
+#if defined(CSV_USE_MMAP) && defined(HAVE_PTHREAD_H)
+#define CSV_USE_THREADS 1
+#endif
+
+#define CSV_MAX_THREADS 256         /* upper limit of CSVTHREADS */
+#ifndef CSV_CHUNK_MIN
+#define CSV_CHUNK_MIN (1 << 20)     /* smallest chunk given to a thread */
+#endif
+#define CSV_CHUNK_MAX (16 << 20)    /* largest chunk given to a thread */
+
+typedef struct csv_pool * csv_pool_p;
+
+/* Function prototypes */
+csv_pool_p csv_pool_start(csv_reader_p reader, int nthreads);
+int csv_pool_read(csv_pool_p pool, csv_reader_p reader);
+void csv_pool_stop(csv_pool_p pool);
+
+#endif
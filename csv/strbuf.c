@@ -13,6 +13,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "strbuf.h"
 
 #define BLKSIZE 256
@@ -33,12 +34,12 @@ void strbuf_start(strbuf_p sb) {
     sb->length = 0;
 }
 
-/* Append a character to the buffer. Expand it if necessary */
+/* Append a character to the buffer. Expand it if necessary, doubling its size */
 int strbuf_put_char(strbuf_p sb, char c) {
     char* newstr;
     int newcap;
     if (sb->length+1 >= sb->capacity) {
-        newcap = sb->capacity + BLKSIZE;
+        newcap = sb->capacity ? 2 * sb->capacity : BLKSIZE;
         newstr = realloc(sb->str, newcap);
         if (newstr == NULL) {
             free(sb->str);
@@ -64,6 +65,29 @@ int strbuf_put_string(strbuf_p sb, char* s) {
     return 0;
 }
 
+/* Append len chars to the buffer. Expand it if necessary */
+int strbuf_put_chars(strbuf_p sb, const char* s, int len) {
+    char* newstr;
+    int newcap;
+    if (sb->length+len >= sb->capacity) {
+        newcap = 2 * sb->capacity;
+        if (newcap <= sb->length+len) {
+            newcap = (sb->length+len) / BLKSIZE * BLKSIZE + BLKSIZE;
+        }
+        newstr = realloc(sb->str, newcap);
+        if (newstr == NULL) {
+            free(sb->str);
+            return 1;
+        } else {
+            sb->str = newstr;
+            sb->capacity = newcap;
+        }
+    }
+    memcpy(&(*sb).str[sb->length], s, len);
+    sb->length += len;
+    return 0;
+}
+
 /* Get a pointer to the C-string value of the buffer */
 char* strbuf_value(strbuf_p sb) {
     if (sb->str) sb->str[sb->length] = '\0';
@@ -16,6 +16,7 @@ int strbuf_init(strbuf_p sb);
 void strbuf_start(strbuf_p sb);
 int strbuf_put_char(strbuf_p sb, char c);
 int strbuf_put_string(strbuf_p sb, char* s);
+int strbuf_put_chars(strbuf_p sb, const char* s, int len);
 char* strbuf_value(strbuf_p sb);
 int strbuf_length(strbuf_p sb);
 void strbuf_free(strbuf_p sb);
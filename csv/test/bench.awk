@@ -0,0 +1,54 @@
+# Measure the CSV parsing throughput of a file made by benchgen.awk
+#   -v mode=MODE     one of:
+#      csvmode     read the file with CSVMODE=1
+#      csvsplit    csvsplit() of every record, read in CSVMODE
+#      csvconvert  csvconvert() of every record, read in CSVMODE
+#      fs          plain awk splitting with FS=","
+#      fpat        plain awk splitting with a CSV-like FPAT
+#   -v shape=SHAPE   only used to label the result
+# Prints one line with MB/s and records/s.
+# For csvsplit and csvconvert, only the calls are timed.
+@include "csv"
+@load "time"
+@load "filefuncs"
+BEGIN {
+    if (mode == "csvmode" || mode == "csvsplit" || mode == "csvconvert") {
+        CSVMODE = 1
+    } else if (mode == "fs") {
+        FS = ","
+    } else if (mode == "fpat") {
+        FPAT = "([^,]*)|(\"([^\"]|\"\")*\")"
+    } else {
+        print "bench: unknown mode `" mode "'" > "/dev/stderr"
+        failed = 1
+        exit 1
+    }
+    if (stat(ARGV[1], st) < 0) {
+        failed = 1
+        exit 1
+    }
+    bytes = st["size"]
+    keep = (mode == "csvsplit" || mode == "csvconvert")
+    t0 = gettimeofday()
+}
+keep {
+    records[NR] = CSVRECORD
+    next
+}
+{
+    nf += NF
+}
+END {
+    if (failed) exit 1
+    if (mode == "csvsplit") {
+        t0 = gettimeofday()
+        for (k = 1; k <= NR; k++) nf += csvsplit(records[k], fields)
+    } else if (mode == "csvconvert") {
+        t0 = gettimeofday()
+        for (k = 1; k <= NR; k++) nf += length(csvconvert(records[k], ","))
+    }
+    t = gettimeofday() - t0
+    if (t <= 0) t = 1e-6
+    printf("%-10s %-10s %9d records %9.2f MB/s %11.0f records/s\n",
+           shape, mode, NR, bytes / t / 1e6, NR / t)
+}
@@ -0,0 +1,32 @@
+# Generate synthetic CSV data for the benchmarks
+#   -v n=RECORDS     number of records, default 100000
+#   -v shape=SHAPE   one of:
+#      narrow     a few short fields, no quotes
+#      wide       100 fields, no quotes
+#      quoted     every text field quoted, with commas and doubled quotes
+#      multiline  quoted fields with embedded CR/LF, CR-LF terminated
+#      nonascii   UTF-8 text, some of it quoted
+# The output depends only on n and shape, so runs can be compared.
+BEGIN {
+    if (n == "") n = 100000
+    if (shape == "") shape = "narrow"
+    split("Ángel García|Loïc Martínez|Åsa Öberg|Jürgen Weiß|Zoë Brontë|Ñandú Peña", names, "|")
+    for (k = 1; k <= n; k++) {
+        if (shape == "narrow") {
+            printf("%d,name%d,%d.%d,x\n", k, k % 1000, k % 97, k % 10)
+        } else if (shape == "wide") {
+            rec = k
+            for (j = 2; j <= 100; j++) rec = rec "," (k * j) % 10007
+            print rec
+        } else if (shape == "quoted") {
+            printf("%d,\"name %d, x\",\"say \"\"hi\"\" %d\",\"%d.5\",\"text, more text\",\"\",\"last\"\n", k, k, k % 13, k)
+        } else if (shape == "multiline") {
+            printf("%d,\"first line %d\r\nsecond line\",\"a\nb\",%d\r\n", k, k, k % 31)
+        } else if (shape == "nonascii") {
+            printf("%d,%s,\"%s, Población %d\",Königsberg,%d€\n", k, names[k % 6 + 1], names[(k + 3) % 6 + 1], k % 50, k % 1000)
+        } else {
+            print "benchgen: unknown shape `" shape "'" > "/dev/stderr"
+            exit 1
+        }
+    }
+}
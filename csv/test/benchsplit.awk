@@ -0,0 +1,20 @@
+# Compare csvsplit() in an awk loop with a single csvsplit_many() call
+@include "csv"
+@load "time"
+{
+    lines[NR] = $0
+}
+END {
+    t0 = gettimeofday()
+    for (k = 1; k <= NR; k++) {
+        nf1 += csvsplit(lines[k], af)
+    }
+    t1 = gettimeofday()
+    csvsplit_many(lines, records)
+    t2 = gettimeofday()
+    for (k in records) {
+        nf2 += length(records[k])
+    }
+    printf("csvsplit loop:  %d records, %d fields, %.3f s\n", NR, nf1, t1 - t0)
+    printf("csvsplit_many:  %d records, %d fields, %.3f s\n", length(records), nf2, t2 - t1)
+}
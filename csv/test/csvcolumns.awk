@@ -0,0 +1,14 @@
+# Only some columns of a CSV file
+@include "csv"
+BEGIN {
+    CSVMODE = 1
+    CSVFS = "|"
+    CSVCOLUMNS = "4, 2"
+}
+{
+    print "<" CSVRECORD "><" RT ">"
+    print "<" $0 ">"
+    for (k=1; k<=NF; k++) {
+        print k "-<" $k ">"
+    }
+}
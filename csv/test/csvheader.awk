@@ -0,0 +1,13 @@
+# Header record in CSVHEADER, fields by name
+@include "csv"
+BEGIN {
+    CSVMODE = 2
+}
+FNR == 1 {
+    n = 0
+    for (name in CSVHEADER) n++
+    print FILENAME ": " n " columns, Zipcode is column " CSVHEADER["Zipcode"]
+}
+{
+    print FNR ": " csvfield("Lastname") " <" csvfield("Zipcode") "> [" csvfield("Phone", "none") "]"
+}
@@ -0,0 +1,12 @@
+# Go to some records of a CSV file through its record offset index
+@include "csv"
+BEGIN {
+    CSVMODE = 1
+    CSVINDEX = "_csvindex.idx"
+    CSVINDEXSTEP = 3
+}
+{ print NR ": <" CSVRECORD ">" }
+NR == 2 { print "csvseek(7) = " csvseek(7) }
+NR == 4 { print "csvseek(4) = " csvseek(4) }
+NR == 7 { print "csvseek(1) = " csvseek(1) }
+NR == 8 { print "csvseek(2, \"nofile\") = " csvseek(2, "nofile") }
@@ -0,0 +1,21 @@
+# Tab separated input without quotes: quote chars are ordinary data
+@include "csv"
+BEGIN {
+    CSVMODE = 1
+    CSVCOMMA = "\t"
+    CSVQUOTE = ""
+    CSVFS = "|"
+}
+{
+    print NR ": <" $0 "> NF=" NF
+    for (k=1; k<=NF; k++) {
+        print k "-<" $k ">"
+    }
+}
+END {
+    n = csvsplit("a\t\"b\tc\"\td", fields, "\t", "")
+    print "csvsplit: " n
+    for (k=1; k<=n; k++) {
+        print k "-<" fields[k] ">"
+    }
+}
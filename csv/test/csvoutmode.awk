@@ -0,0 +1,28 @@
+@include "csv"
+BEGIN {
+    OFS = "|"
+    CSVOUTMODE = 1
+    print "a", "b,c", "say \"hi\"" > "junk"
+    print "multi\nline", "x" > "junk"
+    print "" > "junk"
+    print "", "", "last" > "junk"
+    print "has|ofs", "y" > "junk"
+    print "ends in\n", "z" > "junk"
+    $0 = "f1|f2|f3"
+    print > "junk"
+    printf("p1|p2\nq1|q2\n") > "junk"
+    close("junk")
+    OFS = " "
+    print "New York", "NY" > "junk2"
+    print "one", "", "three" > "junk2"
+    print "x", " ", "y" > "junk2"
+    print "x", "\n", "y" > "junk2"
+    $0 = "no quotes"
+    print > "junk2"
+    close("junk2")
+    CSVOUTMODE = 0
+    while ((getline line < "junk") > 0) print "<" line ">"
+    close("junk")
+    while ((getline line < "junk2") > 0) print "<" line ">"
+    close("junk2")
+}
@@ -0,0 +1,11 @@
+@include "csv"
+{
+    records[NR] = $0
+}
+END {
+    print "numrecords: " csvsplit_many(records, ar)
+    for (r=1; r in ar; r++) {
+        print "numfields: " length(ar[r])
+        for (k=1; k in ar[r]; k++) print k " -> <" ar[r][k] ">"
+    }
+}
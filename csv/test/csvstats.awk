@@ -0,0 +1,14 @@
+# Input counters of CSV files
+@include "csv"
+BEGIN {
+    CSVMODE = 1
+}
+FNR == 3 {
+    csvstats(stats, FILENAME)
+    print FILENAME ": " stats["records"] " records, " stats["fields"] " fields, " stats["quoted"] " quoted"
+}
+END {
+    print "csvstats(stats, \"nofile\") = " csvstats(stats, "nofile")
+    csvstats(stats)
+    print "total: " stats["bytes"] " bytes, " stats["records"] " records, " stats["fields"] " fields, " stats["quoted"] " quoted, " stats["errors"] " errors"
+}
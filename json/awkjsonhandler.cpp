@@ -43,6 +43,26 @@ extern awk_ext_id_t ext_id;
 	m_currentValue.bool_value = val ? awk_true : awk_false;
 #endif
 
+// Short strings come back again and again in JSON data: levels, states,
+// units, names of things. The last ones seen are kept as value cookies,
+// which the array elements share instead of each having its own copy.
+// A string becomes a cookie when it is seen twice in a row in its slot,
+// so that unique strings cost no more than before.
+//
+// gawk takes over the memory of the index strings, so the keys still
+// need a copy each.
+
+#define CACHE_SLOTS	256
+#define CACHE_MAXLEN	24
+
+static struct cacheSlot {
+	awk_value_cookie_t cookie;		// the shared value, or NULL
+	size_t		len;			// and its text
+	char		text[CACHE_MAXLEN];
+	size_t		missLen;		// the last other string seen
+	char		missText[CACHE_MAXLEN];
+} stringCache[CACHE_SLOTS];
+
 // Null --- create a null value
 bool AwkJsonHandler::Null()
 {
@@ -112,7 +132,7 @@ bool AwkJsonHandler::Double(double d)
 // String --- create a string value
 bool AwkJsonHandler::String(const char* str, SizeType length, bool copy)
 {
-	bool strIsRegexp = (str[0] == '@' && str[1] == '/' && str[length-1] == '/');
+	bool strIsRegexp = (length >= 3 && str[0] == '@' && str[1] == '/' && str[length-1] == '/');
 
 	if (strIsRegexp) {
 		size_t newLen = length - 3;
@@ -123,6 +143,8 @@ bool AwkJsonHandler::String(const char* str, SizeType length, bool copy)
 		m_currentValue.str_value.str = (char *) gawk_malloc(newLen + 1);
 		memcpy(m_currentValue.str_value.str, str + 2, newLen);
 		m_currentValue.str_value.str[newLen] = '\0';
+	} else if (length <= CACHE_MAXLEN && cachedString(str, length)) {
+		// m_currentValue is set
 	} else {
 		setValueType(AWK_STRNUM);
 
@@ -135,6 +157,48 @@ bool AwkJsonHandler::String(const char* str, SizeType length, bool copy)
 	return setElement();
 }
 
+// cachedString --- make the current value a shared one, if the string is cached
+bool AwkJsonHandler::cachedString(const char* str, size_t length)
+{
+	unsigned hash = 2166136261u;	// FNV-1a
+
+	for (size_t i = 0; i < length; i++)
+		hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+
+	cacheSlot *slot = & stringCache[hash % CACHE_SLOTS];
+
+	if (slot->cookie == NULL || slot->len != length || memcmp(slot->text, str, length) != 0) {
+		if (slot->missLen != length || memcmp(slot->missText, str, length) != 0) {
+			// first time in a row: remember it only
+			slot->missLen = length;
+			memcpy(slot->missText, str, length);
+			return false;
+		}
+
+		// second time: make it a shared value
+		awk_value_t val;
+		awk_value_cookie_t cookie;
+
+		char *text = (char *) gawk_malloc(length + 1);
+		memcpy(text, str, length);
+		text[length] = '\0';
+		if (! create_value(make_malloced_user_input(text, length, & val), & cookie)) {
+			gawk_free(text);
+			return false;
+		}
+		if (slot->cookie != NULL)
+			release_value(slot->cookie);
+		slot->cookie = cookie;
+		slot->len = length;
+		memcpy(slot->text, str, length);
+		slot->missLen = CACHE_MAXLEN + 1;	// matches nothing
+	}
+
+	setValueType(AWK_VALUE_COOKIE);
+	m_currentValue.value_cookie = slot->cookie;
+	return true;
+}
+
 // Key --- Set the current key
 bool AwkJsonHandler::Key(const char* str, SizeType length, bool copy)
 {
@@ -146,6 +210,13 @@ bool AwkJsonHandler::Key(const char* str, SizeType length, bool copy)
 	return true;
 }
 
+// Skip --- leave out the next value, but keep the indices of the rest
+void AwkJsonHandler::Skip()
+{
+	if (m_processingArray)
+		m_currentIndex++;
+}
+
 // setElement --- install an element into the array being built
 bool AwkJsonHandler::setElement()
 {
@@ -155,13 +226,17 @@ bool AwkJsonHandler::setElement()
 	elem.value = m_currentValue;
 
 	if (m_processingArray) {
-		char buf[1000];
-
-		sprintf(buf, "%lu", m_currentIndex++);
-
-		awk_value_t val;
-		make_const_string(buf, strlen(buf), & val);
-		elem.index = val;
+		// Numeric subscripts save formatting and allocating a string.
+		// A subarray takes its name from its subscript, so that one
+		// still gets a string.
+		if (m_currentValue.val_type == AWK_ARRAY) {
+			char buf[32];
+			int len = sprintf(buf, "%lu", (unsigned long) m_currentIndex);
+
+			make_const_string(buf, len, & elem.index);
+		} else
+			make_number(m_currentIndex, & elem.index);
+		m_currentIndex++;
 	} else {
 		elem.index.val_type = AWK_STRING;
 		elem.index.str_value = m_currentKey;
@@ -257,10 +332,6 @@ bool AwkJsonHandler::EndArray(SizeType elementCount)
 		// log an error
 	}
 
-	bool ret = EndObject(elementCount);
-
-	m_processingArray = false;
-	m_currentIndex = 1;	// AWK arrays start at 1
-
-	return ret;
+	// this brings back the state of the enclosing array or object
+	return EndObject(elementCount);
 }
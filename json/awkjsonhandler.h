@@ -17,7 +17,7 @@
 
 // NOTE: You must include "gawkapi.h" before this file
 
-#include <list>
+#include <vector>
 #include "rapidjson/reader.h"
 
 struct AwkJsonHandler :
@@ -37,6 +37,8 @@ public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, AwkJsonHandler> {
 	bool StartArray();
 	bool EndArray(rapidjson::SizeType elementCount);
 
+	void Skip();	// the next value is left out
+
 	AwkJsonHandler(awk_array_t outArray)
 	: m_outArray(outArray),
 	  m_currentIndex(0),
@@ -44,10 +46,12 @@ public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, AwkJsonHandler> {
 	  m_level(0)
 	{
 		memset(& m_currentKey, 0, sizeof(m_currentKey));
+		m_memberStack.reserve(16);
 	}
 
 private:
 	bool setElement();	// set the current element into the current array
+	bool cachedString(const char *str, size_t length);	// use a shared value
 	void pushMembers();	// push working members onto stack
 	void popMembers();	// pop them off again
 	void initMembers();	// zero out the members
@@ -83,5 +87,5 @@ private:
 		}
 	};
 
-	std::list<inProgress>  m_memberStack;
+	std::vector<inProgress>  m_memberStack;
 };
@@ -22,14 +22,21 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <math.h>
+#include <limits.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <iostream>
+#include <string>
+#include "rapidjson/document.h"
 #include "rapidjson/writer.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
 #include <gawkapi.h>
 
 #include "awkjsonhandler.h"
+#include "jsonthreads.h"
 
 
 const gawk_api_t *api;	/* for convenience macros to work */
@@ -52,8 +59,119 @@ int plugin_is_GPL_compatible;
 #endif
 
 // Forward declarations:
-static bool write_array(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_array_t array, bool do_linear_arrays);
-static bool write_elem(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_element_t *element, bool do_linear_arrays);
+template <typename Writer>
+static bool write_array(Writer& writer, awk_array_t array, bool do_linear_arrays);
+template <typename Writer>
+static bool write_elem(Writer& writer, awk_element_t *element, bool do_linear_arrays);
+
+
+// GawkBuffer --- rapidjson output stream into memory from gawk_malloc(),
+// so that the result goes to gawk without a copy
+
+class GawkBuffer {
+public:
+	typedef char Ch;
+
+	GawkBuffer()
+	: m_buf(NULL),
+	  m_len(0),
+	  m_size(0),
+	  m_failed(false)
+	{
+	}
+
+	~GawkBuffer()
+	{
+		if (m_buf != NULL)
+			gawk_free(m_buf);
+	}
+
+	void Put(char c)
+	{
+		if (m_len == m_size && ! grow())
+			return;
+		m_buf[m_len++] = c;
+	}
+
+	void Flush() { }
+
+	// release --- hand over the text, NULL if out of memory
+	char *release(size_t *len)
+	{
+		Put('\0');
+		if (m_failed)
+			return NULL;
+
+		char *buf = m_buf;
+		*len = m_len - 1;
+		m_buf = NULL;
+		m_len = m_size = 0;
+		return buf;
+	}
+
+private:
+	bool grow()
+	{
+		size_t size = (m_size == 0 ? 256 : 2 * m_size);
+		char *buf;
+
+		if (m_failed || (buf = (char *) gawk_realloc(m_buf, size)) == NULL) {
+			m_failed = true;
+			return false;
+		}
+		m_buf = buf;
+		m_size = size;
+		return true;
+	}
+
+	char	*m_buf;
+	size_t	m_len;
+	size_t	m_size;
+	bool	m_failed;
+};
+
+// GawkFileStream --- rapidjson output stream to a gawk output file.
+//
+// It is buffered as rapidjson::FileWriteStream, but writes with the
+// gawk_fwrite() of the file, as print does, so that output wrappers
+// and the output of print see the same stream.
+
+#define JSON_OUTPUT_BUFSIZE	(16 * 1024)
+
+class GawkFileStream {
+public:
+	typedef char Ch;
+
+	GawkFileStream(const awk_output_buf_t *outbuf)
+	: m_outbuf(outbuf),
+	  m_len(0),
+	  m_failed(false)
+	{
+	}
+
+	void Put(char c)
+	{
+		if (m_len == sizeof(m_buf))
+			Flush();
+		m_buf[m_len++] = c;
+	}
+
+	void Flush()
+	{
+		if (m_len > 0 && ! m_failed
+		    && m_outbuf->gawk_fwrite(m_buf, 1, m_len, m_outbuf->fp, m_outbuf->opaque) != m_len)
+			m_failed = true;
+		m_len = 0;
+	}
+
+	bool failed() const { return m_failed; }
+
+private:
+	const awk_output_buf_t *m_outbuf;
+	char	m_buf[JSON_OUTPUT_BUFSIZE];
+	size_t	m_len;
+	bool	m_failed;
+};
 
 
 // Borrowed from gawk:
@@ -71,8 +189,9 @@ double_to_int(double d)
 
 /* write_value --- write a number or a string or a strnum or a regex or an array */
 
+template <typename Writer>
 static bool
-write_value(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_value_t *val, bool do_linear_arrays)
+write_value(Writer& writer, awk_value_t *val, bool do_linear_arrays)
 {
 	switch (val->val_type) {
 	case AWK_ARRAY:
@@ -116,8 +235,9 @@ write_value(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_value_t *val
 
 /* write_elem --- write out a single element */
 
+template <typename Writer>
 static bool
-write_elem(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_element_t *element, bool do_linear_arrays)
+write_elem(Writer& writer, awk_element_t *element, bool do_linear_arrays)
 {
 	std::string key(element->index.str_value.str, element->index.str_value.len);
 
@@ -127,38 +247,44 @@ write_elem(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_element_t *el
 	return write_value(writer, & element->value, do_linear_arrays);
 }
 
-// compare --- comparison function for qsort, sorting array of pointers
+// linear_order --- put the elements of an array indexed from 1 to N in order.
 //
-// We want to order an integer-indexed array by integer value. But awk
-// indices are strings, so convert them to numbers.
+// This takes one pass: each index is read once, and the element goes
+// straight to its slot. The indices are strings, and only the usual
+// form of each number counts, so that "01" or "1.0" make an object.
+// Such numbers are all different, so N of them from 1 to N fill every
+// slot. Return false at the first index that does not fit.
 
-static int
-compare(const void *l, const void *r)
+static bool
+linear_order(awk_flat_array_t *flat_array, awk_element_t **sorted_elems)
 {
-	awk_element_t **ll = (awk_element_t **) l;
-	awk_element_t **rr = (awk_element_t **) r;
-
-	awk_element_t *left_elem = *ll;
-	awk_element_t *right_elem = *rr;
-
-	char *endptr_l, *endptr_r;
-	const char *left_str = left_elem->index.str_value.str;
-	const char *right_str = right_elem->index.str_value.str;
-
-	long left_val = strtol(left_str, & endptr_l, 10);
-	long right_val = strtol(right_str, & endptr_r, 10);
-
-	// check for invalid conversions
-	if (endptr_l == left_str || endptr_r == right_str)
-		return strcmp(left_str, right_str);
+	size_t count = flat_array->count;
+
+	for (size_t i = 0; i < count; i++) {
+		const char *str = flat_array->elements[i].index.str_value.str;
+		size_t len = flat_array->elements[i].index.str_value.len;
+		size_t index = 0;
+
+		if (len == 0 || str[0] == '0')
+			return false;
+		for (size_t j = 0; j < len; j++) {
+			if (str[j] < '0' || str[j] > '9')
+				return false;
+			index = 10 * index + (str[j] - '0');
+			if (index > count)
+				return false;
+		}
+		sorted_elems[index - 1] = & flat_array->elements[i];
+	}
 
-	return left_val - right_val;
+	return true;
 }
 
 /* write_array --- write out an array or a sub-array */
 
+template <typename Writer>
 static bool
-write_array(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_array_t array, bool do_linear_arrays)
+write_array(Writer& writer, awk_array_t array, bool do_linear_arrays)
 {
 	uint32_t i;
 	awk_flat_array_t *flat_array;
@@ -174,23 +300,10 @@ write_array(rapidjson::Writer<rapidjson::StringBuffer>& writer, awk_array_t arra
 
 	if (do_linear_arrays) {
 		sorted_elems = new awk_element_t*[flat_array->count];
-		for (i = 0; i < flat_array->count; i++)
-			sorted_elems[i] = & flat_array->elements[i];
-
-		// sort the array of pointers
-		qsort(sorted_elems, flat_array->count, sizeof(*sorted_elems), compare);
 
 		// check that this is a linear array
-		for (i = 0; i < flat_array->count; i++) {
-			char buf[100];
-
-			sprintf(buf, "%d", i + 1);
-			if (strlen(buf) != sorted_elems[i]->index.str_value.len
-			    || strcmp(buf, sorted_elems[i]->index.str_value.str) != 0) {
-				// nope!
-				goto regular_array;
-			}
-		}
+		if (! linear_order(flat_array, sorted_elems))
+			goto regular_array;
 
 		writer.StartArray();
 		// now traverse
@@ -226,127 +339,1565 @@ done:
 }
 
 
-extern "C" {
-/*  do_json_fromJSON --- convert JSON string to an array */
+/*
+ * JSON Pointers (RFC 6901) for json::get() and json::extract(). The
+ * document goes through the SAX reader once, and only the values the
+ * pointers name are kept: nothing is built for the rest of it. When
+ * all of them are found, the handler stops the reader.
+ */
+
+struct json_pointer {
+	std::vector<std::string> tokens;	// the reference tokens, unescaped
+	std::vector<long> indices;	// tokens as array indices, or -1
+
+	size_t		matched;	// leading tokens that match the current path
+	size_t		level;		// level of the container being copied, or 0
+	size_t		start;		// and where it starts
+	bool		found;
+	awk_value_t	value;		// the value, once found
+};
+
+/* parse_pointer --- split a JSON Pointer into its tokens */
+
+static bool
+parse_pointer(const char *str, size_t len, json_pointer& ptr)
+{
+	ptr.tokens.clear();
+	ptr.indices.clear();
+	ptr.matched = ptr.level = ptr.start = 0;
+	ptr.found = false;
+	memset(& ptr.value, 0, sizeof(ptr.value));
+
+	if (len == 0)		// the whole document
+		return true;
+	if (str[0] != '/')
+		return false;
+
+	for (size_t i = 1; i <= len; i++) {
+		std::string token;
+		long index = 0;
+
+		for (; i < len && str[i] != '/'; i++) {
+			if (str[i] != '~')
+				token += str[i];
+			else if (i + 1 < len && (str[i+1] == '0' || str[i+1] == '1'))
+				token += (str[++i] == '0' ? '~' : '/');
+			else
+				return false;
+		}
+
+		// array indices have no leading zeros, and "-" is never there
+		if (token.empty() || (token[0] == '0' && token.size() > 1))
+			index = -1;
+		for (size_t j = 0; j < token.size() && index >= 0; j++) {
+			if (token[j] < '0' || token[j] > '9' || index > LONG_MAX / 10 - 1)
+				index = -1;
+			else
+				index = 10 * index + (token[j] - '0');
+		}
+
+		ptr.tokens.push_back(token);
+		ptr.indices.push_back(index);
+	}
+
+	return true;
+}
+
+/* free_pointer_value --- free the value of a pointer that is not used */
+
+static void
+free_pointer_value(json_pointer& ptr)
+{
+	if (ptr.found && (ptr.value.val_type == AWK_STRING || ptr.value.val_type == AWK_STRNUM))
+		gawk_free(ptr.value.str_value.str);
+	ptr.found = false;
+}
+
+/*
+ * match_pointers --- a member of an object, or an element of an array,
+ * is next at the level: update how many tokens of each pointer match
+ */
+
+static void
+match_pointers(std::vector<json_pointer>& pointers, size_t level,
+		const char *key, size_t len, long index)
+{
+	for (size_t i = 0; i < pointers.size(); i++) {
+		json_pointer& p = pointers[i];
+
+		if (p.matched + 1 < level)
+			continue;
+		p.matched = level - 1;
+		if (p.tokens.size() < level)
+			continue;
+		if (key != NULL
+		    ? (p.tokens[level-1].size() == len
+		       && memcmp(p.tokens[level-1].data(), key, len) == 0)
+		    : p.indices[level-1] == index)
+			p.matched = level;
+	}
+}
+
+/* make_json_bool --- a JSON boolean as a gawk value, as from_json() makes it */
 
 static awk_value_t *
-do_json_fromJSON(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+make_json_bool(bool b, awk_value_t *result)
 {
-	bool success = false;
-	errno = 0;
+#if gawk_api_major_version > 3 || (gawk_api_major_version == 3 && gawk_api_minor_version >= 2)
+	return make_bool(b ? awk_true : awk_false, result);
+#else
+	return make_number(b ? 1.0 : 0.0, result);
+#endif
+}
 
-	if (nargs != 2) {
-		if (do_lint)
-			lintwarn(ext_id, _("json::from_json: expecting two arguments, received %d"), nargs);
-		goto out;
+// PointerHandler --- find the values that JSON Pointers name.
+//
+// For every pointer it keeps how many of its tokens match the path of
+// the value being read. A scalar matches when all of them do. An object
+// or array that matches is copied as JSON text, from where it starts up
+// to the position of the stream when it ends. An object or array that
+// no pointer goes into is skipped: only its nesting is counted.
+
+struct PointerHandler :
+public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, PointerHandler> {
+	PointerHandler(std::vector<json_pointer>& pointers, const char *text,
+			const rapidjson::MemoryStream& stream, bool first_only)
+	: m_pointers(pointers),
+	  m_text(text),
+	  m_stream(stream),
+	  m_first_only(first_only),
+	  m_left(pointers.size()),
+	  m_level(0),
+	  m_skip(0)
+	{
+		m_index.reserve(16);
 	}
 
-	// get first argument, should be a string
-	awk_value_t data, array;
-	if (! get_argument(0, AWK_STRING, & data)) {
-		nonfatal(ext_id, _("json::from_json: first argument is not a string"));
-		errno = EINVAL;
-		goto done;
+	bool Null()
+	{
+		awk_value_t val;
+
+		if (! wanted())
+			return true;
+		val.val_type = AWK_UNDEFINED;
+		return scalar(val);
 	}
 
-	// get second argument, should be a target array
-	if (! get_argument(1, AWK_ARRAY, & array)) {
-		nonfatal(ext_id, _("json::from_json: second argument is not an array"));
-		errno = EINVAL;
-		goto done;
+	bool Bool(bool b)
+	{
+		awk_value_t val;
+
+		if (! wanted())
+			return true;
+		return scalar(*make_json_bool(b, & val));
 	}
 
-	// Clear the target array
-	if (! clear_array(array.array_cookie)) {
-		nonfatal(ext_id, _("json::from_json: clear_array failed"));
-		errno = ENOMEM;
-		goto done;
+	bool Int(int i)			{ return number(i); }
+	bool Uint(unsigned u)		{ return number(u); }
+	bool Int64(int64_t i)		{ return number(i); }
+	bool Uint64(uint64_t u)		{ return number(u); }
+	bool Double(double d)		{ return number(d); }
+
+	bool String(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		awk_value_t val;
+
+		if (! wanted())
+			return true;
+
+		char *s = (char *) gawk_malloc(length + 1);
+		memcpy(s, str, length);
+		s[length] = '\0';
+		return scalar(*make_malloced_user_input(s, length, & val));
 	}
 
-	// open new scope for object creation / destruction
-	// lets us use goto in the above code
+	bool Key(const char* str, rapidjson::SizeType length, bool copy)
 	{
-		// Create SAX object
-		AwkJsonHandler handler(array.array_cookie);
-		rapidjson::Reader reader;
-		rapidjson::StringStream ss(data.str_value.str);
+		if (! m_skip)
+			match_pointers(m_pointers, m_level, str, length, -1);
+		return true;
+	}
 
-		// convert from JSON
-		success = reader.Parse(ss, handler);
+	bool StartObject()		{ return begin(false); }
+	bool StartArray()		{ return begin(true); }
+	bool EndObject(rapidjson::SizeType memberCount)	{ return end(); }
+	bool EndArray(rapidjson::SizeType elementCount)	{ return end(); }
+
+	// done --- true if there is nothing more to look for
+	bool done() const
+	{
+		return m_left == 0 || (m_first_only && m_pointers[0].found);
 	}
-	if (! success)
-		errno = EINVAL;
 
-done:
-	if (errno != 0)
-		update_ERRNO_int(errno);
+private:
+	bool number(double d)
+	{
+		awk_value_t val;
 
-out:
-	// return success / failure
-	return make_number(success, result);
-}
+		if (! wanted())
+			return true;
+		return scalar(*make_number(d, & val));
+	}
 
-/*  do_json_toJSON --- convert an array to JSON */
+	// element --- in an array, each value is the next element
+	void element()
+	{
+		if (m_level > 0 && m_index.back() >= 0)
+			match_pointers(m_pointers, m_level, NULL, 0, m_index.back()++);
+	}
 
-static awk_value_t *
-do_json_toJSON(int nargs, awk_value_t *result, awk_ext_func_t *unused)
-{
-	awk_value_t source;
+	// matches --- true if the pointer names the value being read
+	bool matches(const json_pointer& p) const
+	{
+		return ! p.found && p.level == 0
+			&& p.matched == m_level && p.tokens.size() == m_level;
+	}
 
-	if (do_lint && (nargs == 0 || nargs > 2))
-		lintwarn(ext_id, _("json::to_json: expecting one or two arguments, received %d"), nargs);
+	// wanted --- start reading a scalar, true if a pointer names it
+	bool wanted()
+	{
+		if (m_skip)
+			return false;
+		element();
+		for (size_t i = 0; i < m_pointers.size(); i++)
+			if (matches(m_pointers[i]))
+				return true;
+		return false;
+	}
 
-	errno = 0;
-	if (! get_argument(0, AWK_ARRAY, & source)) {
-		nonfatal(ext_id, _("json::to_json: first argument is not an array\n"));
-		errno = EINVAL;
-		update_ERRNO_int(errno);
-		return make_const_string("", 0, result);
+	// found --- a pointer has its value; false stops the reader
+	bool found(json_pointer& p, const awk_value_t& val)
+	{
+		p.value = val;
+		p.found = true;
+		m_left--;
+		return ! done();
 	}
 
-	bool do_linear_arrays = false;
-	awk_value_t linear_arrays;
-	if (nargs == 2) {
-		if (get_argument(1, AWK_NUMBER, & linear_arrays)) {
-			do_linear_arrays = (linear_arrays.num_value != 0);
-		} else {
-			errno = EINVAL;
-			update_ERRNO_int(errno);
-			return make_const_string("", 0, result);
+	// scalar --- give the value to the pointers that name it
+	bool scalar(const awk_value_t& val)
+	{
+		bool more = true;
+		bool shared = false;
+
+		for (size_t i = 0; i < m_pointers.size(); i++) {
+			if (! matches(m_pointers[i]))
+				continue;
+
+			awk_value_t copy = val;
+
+			// the same pointer twice: each one owns its string
+			if (shared && val.val_type == AWK_STRNUM) {
+				copy.str_value.str = (char *) gawk_malloc(val.str_value.len + 1);
+				memcpy(copy.str_value.str, val.str_value.str, val.str_value.len + 1);
+			}
+			shared = true;
+			more = found(m_pointers[i], copy) && more;
 		}
+		return more;
 	}
 
-	rapidjson::StringBuffer s;
-	rapidjson::Writer<rapidjson::StringBuffer> writer(s);
+	// begin --- an object or array was opened
+	bool begin(bool array)
+	{
+		if (m_skip) {
+			m_level++;
+			return true;
+		}
+		element();
 
-	if (write_array(writer, source.array_cookie, do_linear_arrays)) {
-		std::string final_json = s.GetString();
+		bool inside = false;
+		for (size_t i = 0; i < m_pointers.size(); i++) {
+			json_pointer& p = m_pointers[i];
 
-		return make_const_string(final_json.c_str(),
-					final_json.length(), result);
-	} else if (errno == 0)
-		errno = EINVAL;	// best guess
+			if (matches(p)) {
+				p.level = m_level + 1;
+				p.start = m_stream.Tell() - 1;
+			} else if (! p.found && p.matched == m_level && p.tokens.size() > m_level)
+				inside = true;
+		}
 
-	update_ERRNO_int(errno);
+		m_level++;
+		if (inside)
+			m_index.push_back(array ? 0 : -1);
+		else
+			m_skip = m_level;
+		return true;
+	}
 
-	return make_null_string(result);
+	// end --- an object or array was closed, copy it if a pointer names it
+	bool end()
+	{
+		bool more = true;
+
+		for (size_t i = 0; i < m_pointers.size(); i++) {
+			json_pointer& p = m_pointers[i];
+
+			if (p.level != m_level)
+				continue;
+
+			awk_value_t val;
+			size_t len = m_stream.Tell() - p.start;
+			char *s = (char *) gawk_malloc(len + 1);
+
+			memcpy(s, m_text + p.start, len);
+			s[len] = '\0';
+			p.level = 0;
+			more = found(p, *make_malloced_string(s, len, & val)) && more;
+		}
+
+		if (m_skip == m_level)
+			m_skip = 0;
+		else if (m_skip == 0)
+			m_index.pop_back();
+		m_level--;
+		return more;
+	}
+
+	std::vector<json_pointer>& m_pointers;
+	const char	*m_text;
+	const rapidjson::MemoryStream& m_stream;
+	bool		m_first_only;	// stop when the first pointer is found
+
+	size_t		m_left;		// pointers not found yet
+	size_t		m_level;	// how deep we are in the document
+	size_t		m_skip;		// level of the container skipped, or 0
+	std::vector<long> m_index;	// next index in each array, -1 in objects
+};
+
+/* find_pointers --- look for the pointers in a JSON text */
+
+static bool
+find_pointers(const awk_string_t& text, std::vector<json_pointer>& pointers, bool first_only)
+{
+	rapidjson::Reader reader;
+	rapidjson::MemoryStream stream(text.str, text.len);
+	PointerHandler handler(pointers, text.str, stream, first_only);
+
+	// the handler stops the reader when it has everything
+	return reader.Parse(stream, handler) || handler.done();
 }
 
+// FilterHandler --- decode only part of a document with an AwkJsonHandler.
+//
+// With JSON Pointers, it passes on the values that a pointer names, with
+// everything inside them, and the objects and arrays on the way to them.
+// With a depth limit, it passes on the objects and arrays that would be
+// at most that many subscripts deep. Everything else never reaches the
+// AwkJsonHandler, so no gawk arrays or strings are made for it. A key is
+// only passed on with its value, once the value is known to be wanted.
+
+struct FilterHandler :
+public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, FilterHandler> {
+	FilterHandler(awk_array_t outArray, std::vector<json_pointer>& pointers, size_t depth)
+	: m_handler(outArray),
+	  m_pointers(pointers),
+	  m_depth(depth),
+	  m_level(0),
+	  m_skip(0),
+	  m_keep(0)
+	{
+		m_index.reserve(16);
+	}
+
+	bool Null()			{ return ! value(false) || m_handler.Null(); }
+	bool Bool(bool b)		{ return ! value(false) || m_handler.Bool(b); }
+	bool Int(int i)			{ return ! value(false) || m_handler.Int(i); }
+	bool Uint(unsigned u)		{ return ! value(false) || m_handler.Uint(u); }
+	bool Int64(int64_t i)		{ return ! value(false) || m_handler.Int64(i); }
+	bool Uint64(uint64_t u)		{ return ! value(false) || m_handler.Uint64(u); }
+	bool Double(double d)		{ return ! value(false) || m_handler.Double(d); }
+
+	bool String(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		return ! value(false) || m_handler.String(str, length, copy);
+	}
+
+	bool Key(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		if (m_skip)
+			return true;
+		if (m_keep)
+			return m_handler.Key(str, length, copy);
+
+		// the reader may reuse the memory of the key for the value
+		m_key.assign(str, length);
+		match_pointers(m_pointers, m_level, str, length, -1);
+		return true;
+	}
+
+	bool StartObject()		{ return ! begin(false) || m_handler.StartObject(); }
+	bool StartArray()		{ return ! begin(true) || m_handler.StartArray(); }
+
+	bool EndObject(rapidjson::SizeType memberCount)
+	{
+		return ! end() || m_handler.EndObject(memberCount);
+	}
+
+	bool EndArray(rapidjson::SizeType elementCount)
+	{
+		return ! end() || m_handler.EndArray(elementCount);
+	}
+
+private:
+	// value --- a value starts, true if it is passed on
+	bool value(bool container)
+	{
+		bool wanted = false;
+
+		if (m_skip)
+			return false;
+		if (m_keep)
+			return true;
+
+		bool in_array = (m_level > 0 && m_index.back() >= 0);
+		if (in_array)
+			match_pointers(m_pointers, m_level, NULL, 0, m_index.back()++);
+
+		if (m_depth > 0)
+			wanted = (! container || m_level < m_depth);
+		for (size_t i = 0; i < m_pointers.size(); i++) {
+			const json_pointer& p = m_pointers[i];
+
+			if (p.matched != m_level)
+				continue;
+			if (p.tokens.size() == m_level) {
+				// all of it
+				wanted = true;
+				if (container)
+					m_keep = m_level + 1;
+				break;
+			}
+			if (container)
+				wanted = true;	// on the way
+		}
+
+		// the document itself is the array being filled
+		if (m_level == 0)
+			return true;
+
+		if (! wanted && in_array)
+			m_handler.Skip();
+		else if (wanted && ! in_array)
+			m_handler.Key(m_key.data(), m_key.size(), true);
+		return wanted;
+	}
+
+	// begin --- an object or array was opened, true if it is passed on
+	bool begin(bool array)
+	{
+		if (! value(true)) {
+			if (m_skip == 0)
+				m_skip = m_level + 1;
+			m_level++;
+			return false;
+		}
+		m_level++;
+		m_index.push_back(array ? 0 : -1);
+		return true;
+	}
+
+	// end --- an object or array was closed, true if it is passed on
+	bool end()
+	{
+		if (m_skip) {
+			if (m_skip == m_level)
+				m_skip = 0;
+			m_level--;
+			return false;
+		}
+		if (m_keep == m_level)
+			m_keep = 0;
+		m_index.pop_back();
+		m_level--;
+		return true;
+	}
+
+	AwkJsonHandler	m_handler;
+	std::vector<json_pointer>& m_pointers;	// the values wanted
+	size_t		m_depth;		// or the depth limit, if not 0
+
+	size_t		m_level;	// how deep we are in the document
+	size_t		m_skip;		// level of the container skipped, or 0
+	size_t		m_keep;		// level of the container passed on whole, or 0
+	std::vector<long> m_index;	// next index in each array, -1 in objects
+	std::string	m_key;		// the key of the next member
+};
 
 /*
- * N.B. the 3rd value in the awk_ext_func_t struct called num_expected_args is
- * actually the maximum number of allowed args. A better name would be
- * max_allowed_args.
+ * Parsed documents, for json::parse() and the functions that query it.
+ * A handle is a number that stands for a rapidjson Document. All of its
+ * values live in the memory pool of the document, and only those that
+ * are asked for become gawk values.
  */
-static awk_ext_func_t func_table[] = {
-	{ "to_json",   do_json_toJSON,   2, 1 },
-	{ "from_json", do_json_fromJSON, 2, 2 },
-};
 
-static awk_bool_t
-init_my_module(void)
+static std::vector<rapidjson::Document *> documents;	// by handle - 1, NULL if free
+static std::vector<size_t> free_slots;			// free slots in the above
+
+/* new_handle --- keep a document, return its handle */
+
+static double
+new_handle(rapidjson::Document *doc)
 {
-	GAWKEXTLIB_COMMON_INIT
+	size_t slot;
+
+	if (! free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+		documents[slot] = doc;
+	} else {
+		slot = documents.size();
+		documents.push_back(doc);
+	}
+
+	return slot + 1;
+}
+
+/* get_document --- the document of a handle argument, or NULL */
+
+static rapidjson::Document *
+get_document(size_t arg, const char *func, size_t *slot)
+{
+	awk_value_t handle;
+
+	if (! get_argument(arg, AWK_NUMBER, & handle)
+	    || handle.num_value < 1 || handle.num_value > documents.size()
+	    || handle.num_value != (size_t) handle.num_value
+	    || documents[(size_t) handle.num_value - 1] == NULL) {
+		nonfatal(ext_id, _("%s: argument %d is not a JSON document handle"), func, (int) arg + 1);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	*slot = (size_t) handle.num_value - 1;
+	return documents[*slot];
+}
+
+/* get_value --- the value in a document that a JSON Pointer argument names, or NULL */
+
+static const rapidjson::Value *
+get_value(const rapidjson::Value *value, size_t arg, const char *func)
+{
+	awk_value_t pointer;
+	json_pointer ptr;
+
+	if (! get_argument(arg, AWK_STRING, & pointer)
+	    || ! parse_pointer(pointer.str_value.str, pointer.str_value.len, ptr)) {
+		nonfatal(ext_id, _("%s: argument %d is not a JSON Pointer"), func, (int) arg + 1);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < ptr.tokens.size() && value != NULL; i++) {
+		const std::string& token = ptr.tokens[i];
+
+		if (value->IsObject()) {
+			rapidjson::Value::ConstMemberIterator m = value->MemberBegin();
+
+			for (; m != value->MemberEnd(); ++m)
+				if (m->name.GetStringLength() == token.size()
+				    && memcmp(m->name.GetString(), token.data(), token.size()) == 0)
+					break;
+			value = (m != value->MemberEnd() ? & m->value : NULL);
+		} else if (value->IsArray() && ptr.indices[i] >= 0
+			   && (size_t) ptr.indices[i] < value->Size())
+			value = & (*value)[(rapidjson::SizeType) ptr.indices[i]];
+		else
+			value = NULL;
+	}
+
+	return value;
+}
+
+/* make_json_value --- a value of a document as a gawk value, as json::get() makes it */
+
+static awk_value_t *
+make_json_value(const rapidjson::Value& value, awk_value_t *result)
+{
+	if (value.IsString()) {
+		size_t len = value.GetStringLength();
+		char *s = (char *) gawk_malloc(len + 1);
+
+		memcpy(s, value.GetString(), len);
+		s[len] = '\0';
+		return make_malloced_user_input(s, len, result);
+	} else if (value.IsNumber())
+		return make_number(value.GetDouble(), result);
+	else if (value.IsBool())
+		return make_json_bool(value.GetBool(), result);
+	else if (value.IsNull())
+		return make_null_string(result);
+
+	// an object or array, as compact JSON text
+	GawkBuffer s;
+	rapidjson::Writer<GawkBuffer> writer(s);
+	size_t len;
+	char *json;
+
+	value.Accept(writer);
+	if ((json = s.release(& len)) == NULL) {
+		errno = ENOMEM;
+		return make_null_string(result);
+	}
+	return make_malloced_string(json, len, result);
+}
+
+/*
+ * JSON Lines input. When JSONMODE is set, every input line is one JSON
+ * document. It is decoded straight from the input buffer into the
+ * JSONREC array, while $0 is the line itself. When JSONMODE is 2, the
+ * top-level values are also the fields $1 .. $NF. When JSONTHREADS is
+ * set, worker threads parse the lines ahead, and the records are played
+ * back from their tapes.
+ */
+
+#ifndef JSON_INPUT_BUFSIZE
+#define JSON_INPUT_BUFSIZE	(64 * 1024)
+#endif
+
+static awk_array_t JSONREC;	// set by init_my_module
+static int json_mode;		// JSONMODE, set by json_can_take_file
+static int json_threads;	// JSONTHREADS, likewise
+
+struct json_input {
+	char		*buf;		// input buffer
+	size_t		size;		// size of the buffer
+	size_t		start;		// start of the unread data
+	size_t		end;		// end of the data read so far
+	bool		eof;		// nothing more to read
+	int		mode;		// JSONMODE when the file was opened
+	unsigned long	record;		// record number, for messages
+	json_pool_p	pool;		// the worker threads, or NULL
+
+	awk_fieldwidth_info_t *fields;	// the fields, for JSONMODE = 2
+	size_t		max_fields;	// room in the above
+	size_t		field_end;	// end of the last field in the record
+};
+
+// awk_fieldwidth_info_size() does not work in C++, its struct is nested
+#define fields_size(nf) \
+	(sizeof(awk_fieldwidth_info_t) + ((nf) - 1) * sizeof(awk_fieldwidth_info_t::awk_field_info))
+
+/* add_field --- note the next field of the record */
+
+static bool
+add_field(json_input *input, size_t start, size_t end)
+{
+	awk_fieldwidth_info_t *fields = input->fields;
+
+	if (fields->nf == input->max_fields) {
+		fields = (awk_fieldwidth_info_t *) gawk_realloc(fields,
+				fields_size(2 * input->max_fields));
+		if (fields == NULL)
+			return false;
+		input->fields = fields;
+		input->max_fields *= 2;
+	}
+	fields->fields[fields->nf].skip = start - input->field_end;
+	fields->fields[fields->nf].len = end - start;
+	fields->nf++;
+	input->field_end = end;
+
+	return true;
+}
+
+// RecordHandler --- decode a record into JSONREC with an AwkJsonHandler.
+//
+// It also notes where the top-level values of the record are, for the
+// fields. The reader has just consumed a value when it reports it, so
+// a value ends at the position of the stream, and starts after the
+// separators that follow the previous one. Strings lose their quotes.
+// The stream is the one being parsed, or a tape being played.
+
+template <typename Stream>
+struct RecordHandler :
+public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, RecordHandler<Stream> > {
+	RecordHandler(awk_array_t outArray, const char *record,
+			const Stream& stream, json_input *input)
+	: m_handler(outArray),
+	  m_record(record),
+	  m_stream(stream),
+	  m_input(input),
+	  m_level(0),
+	  m_last(0),
+	  m_start(0)
+	{
+	}
+
+	bool Null()			{ return value(0) && m_handler.Null(); }
+	bool Bool(bool b)		{ return value(0) && m_handler.Bool(b); }
+	bool Int(int i)			{ return value(0) && m_handler.Int(i); }
+	bool Uint(unsigned u)		{ return value(0) && m_handler.Uint(u); }
+	bool Int64(int64_t i)		{ return value(0) && m_handler.Int64(i); }
+	bool Uint64(uint64_t u)		{ return value(0) && m_handler.Uint64(u); }
+	bool Double(double d)		{ return value(0) && m_handler.Double(d); }
+
+	bool String(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		return value(1) && m_handler.String(str, length, copy);
+	}
+
+	bool Key(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		m_last = m_stream.Tell();
+		return m_handler.Key(str, length, copy);
+	}
+
+	bool StartObject()		{ return begin() && m_handler.StartObject(); }
+	bool StartArray()		{ return begin() && m_handler.StartArray(); }
+
+	bool EndObject(rapidjson::SizeType memberCount)
+	{
+		return end() && m_handler.EndObject(memberCount);
+	}
+
+	bool EndArray(rapidjson::SizeType elementCount)
+	{
+		return end() && m_handler.EndArray(elementCount);
+	}
+
+private:
+	// value --- a scalar was read, quote is the length of its quotes
+	bool value(size_t quote)
+	{
+		size_t end = m_stream.Tell();
+		bool ret = true;
+
+		if (m_input != NULL && m_level <= 1)
+			ret = add_field(m_input, skip(m_last) + quote, end - quote);
+		m_last = end;
+		return ret;
+	}
+
+	// begin --- an object or array was opened, note where
+	bool begin()
+	{
+		m_last = m_stream.Tell();
+		if (m_level++ == 1)
+			m_start = m_last - 1;
+		return true;
+	}
+
+	// end --- an object or array was closed, a field if it is top-level
+	bool end()
+	{
+		bool ret = true;
+
+		m_last = m_stream.Tell();
+		if (--m_level == 1 && m_input != NULL)
+			ret = add_field(m_input, m_start, m_last);
+		return ret;
+	}
+
+	// skip --- skip white space and separators after pos
+	size_t skip(size_t pos)
+	{
+		for (;; pos++) {
+			switch (m_record[pos]) {
+			case ' ': case '\t': case '\r': case '\n': case ':': case ',':
+				continue;
+			}
+			return pos;
+		}
+	}
+
+	AwkJsonHandler	m_handler;
+	const char	*m_record;
+	const Stream&	m_stream;
+	json_input	*m_input;	// NULL if there are no fields
+
+	size_t		m_level;	// how deep we are in the record
+	size_t		m_last;		// end of the last thing read
+	size_t		m_start;	// start of the top-level value being read
+};
+
+/* fill_buffer --- read more input after the unread data */
+
+static bool
+fill_buffer(awk_input_buf_t *iobuf, json_input *input)
+{
+	ssize_t n;
+
+	// move the unread data to the front, or make room for more
+	if (input->start > 0) {
+		memmove(input->buf, input->buf + input->start, input->end - input->start);
+		input->end -= input->start;
+		input->start = 0;
+	} else if (input->end == input->size) {
+		char *buf = (char *) gawk_realloc(input->buf, 2 * input->size);
+
+		if (buf == NULL) {
+			errno = ENOMEM;
+			return false;
+		}
+		input->buf = buf;
+		input->size *= 2;
+	}
+
+	n = iobuf->read_func(iobuf->fd, input->buf + input->end, input->size - input->end);
+	if (n < 0)
+		return false;
+	if (n == 0)
+		input->eof = true;
+	input->end += n;
+
+	return true;
+}
+
+
+extern "C" {
+/*  do_json_fromJSON --- convert JSON string to an array */
+
+static awk_value_t *
+do_json_fromJSON(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	bool success = false;
+	std::vector<json_pointer> pointers;
+	size_t depth = 0;
+	errno = 0;
+
+	if (nargs < 2 || nargs > 3) {
+		if (do_lint)
+			lintwarn(ext_id, _("json::from_json: expecting two or three arguments, received %d"), nargs);
+		goto out;
+	}
+
+	// get first argument, should be a string
+	awk_value_t data, array, filter;
+	if (! get_argument(0, AWK_STRING, & data)) {
+		nonfatal(ext_id, _("json::from_json: first argument is not a string"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	// get second argument, should be a target array
+	if (! get_argument(1, AWK_ARRAY, & array)) {
+		nonfatal(ext_id, _("json::from_json: second argument is not an array"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	// get third argument, JSON Pointers in an array or a depth limit
+	if (nargs == 3 && get_argument(2, AWK_UNDEFINED, & filter)
+	    && filter.val_type == AWK_ARRAY) {
+		awk_flat_array_t *flat_array;
+
+		if (! flatten_array_typed(filter.array_cookie, & flat_array, AWK_STRING, AWK_STRING)) {
+			nonfatal(ext_id, _("json::from_json: could not flatten array"));
+			errno = ENOMEM;
+			goto done;
+		}
+		pointers.resize(flat_array->count);
+		for (size_t i = 0; i < flat_array->count && errno == 0; i++) {
+			const awk_string_t& path = flat_array->elements[i].value.str_value;
+
+			if (! parse_pointer(path.str, path.len, pointers[i])) {
+				nonfatal(ext_id, _("json::from_json: `%s' is not a JSON Pointer"), path.str);
+				errno = EINVAL;
+			}
+		}
+		if (! release_flattened_array(filter.array_cookie, flat_array)) {
+			warning(ext_id, _("json::from_json: could not release flattened array"));
+			errno = ENOMEM;
+		}
+		if (errno != 0)
+			goto done;
+	} else if (nargs == 3) {
+		if (! get_argument(2, AWK_NUMBER, & filter) || filter.num_value < 1) {
+			nonfatal(ext_id, _("json::from_json: third argument is not an array or a depth of at least 1"));
+			errno = EINVAL;
+			goto done;
+		}
+		depth = (filter.num_value < SIZE_MAX ? (size_t) filter.num_value : SIZE_MAX);
+	}
+
+	// Clear the target array
+	if (! clear_array(array.array_cookie)) {
+		nonfatal(ext_id, _("json::from_json: clear_array failed"));
+		errno = ENOMEM;
+		goto done;
+	}
+
+	// open new scope for object creation / destruction
+	// lets us use goto in the above code
+	if (nargs == 3) {
+		// Create SAX object that leaves out what is not wanted
+		FilterHandler handler(array.array_cookie, pointers, depth);
+		rapidjson::Reader reader;
+		rapidjson::StringStream ss(data.str_value.str);
+
+		// convert from JSON
+		success = reader.Parse(ss, handler);
+	} else {
+		// Create SAX object
+		AwkJsonHandler handler(array.array_cookie);
+		rapidjson::Reader reader;
+		rapidjson::StringStream ss(data.str_value.str);
+
+		// convert from JSON
+		success = reader.Parse(ss, handler);
+	}
+	if (! success)
+		errno = EINVAL;
+
+done:
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+out:
+	// return success / failure
+	return make_number(success, result);
+}
+
+/*  do_json_toJSON --- convert an array to JSON */
+
+static awk_value_t *
+do_json_toJSON(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	awk_value_t source;
+
+	if (do_lint && (nargs == 0 || nargs > 2))
+		lintwarn(ext_id, _("json::to_json: expecting one or two arguments, received %d"), nargs);
+
+	errno = 0;
+	if (! get_argument(0, AWK_ARRAY, & source)) {
+		nonfatal(ext_id, _("json::to_json: first argument is not an array\n"));
+		errno = EINVAL;
+		update_ERRNO_int(errno);
+		return make_const_string("", 0, result);
+	}
+
+	bool do_linear_arrays = false;
+	awk_value_t linear_arrays;
+	if (nargs == 2) {
+		if (get_argument(1, AWK_NUMBER, & linear_arrays)) {
+			do_linear_arrays = (linear_arrays.num_value != 0);
+		} else {
+			errno = EINVAL;
+			update_ERRNO_int(errno);
+			return make_const_string("", 0, result);
+		}
+	}
+
+	GawkBuffer s;
+	rapidjson::Writer<GawkBuffer> writer(s);
+
+	if (write_array(writer, source.array_cookie, do_linear_arrays)) {
+		size_t len;
+		char *final_json = s.release(& len);
+
+		if (final_json != NULL)
+			return make_malloced_string(final_json, len, result);
+		errno = ENOMEM;
+	} else if (errno == 0)
+		errno = EINVAL;	// best guess
+
+	update_ERRNO_int(errno);
+
+	return make_null_string(result);
+}
+
+/*  do_json_writeJSON --- write an array as JSON to a file */
+
+static awk_value_t *
+do_json_writeJSON(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	awk_value_t source, file, linear_arrays;
+	const awk_input_buf_t *ibuf;
+	const awk_output_buf_t *obuf;
+	bool do_linear_arrays = false;
+	bool success = false;
+
+	errno = 0;
+	if (! get_argument(0, AWK_ARRAY, & source)) {
+		nonfatal(ext_id, _("json::write_json: first argument is not an array"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (! get_argument(1, AWK_STRING, & file)) {
+		nonfatal(ext_id, _("json::write_json: second argument is not a file name"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (nargs == 3) {
+		if (get_argument(2, AWK_NUMBER, & linear_arrays)) {
+			do_linear_arrays = (linear_arrays.num_value != 0);
+		} else {
+			errno = EINVAL;
+			goto done;
+		}
+	}
+
+	// the same output file as for print > file
+	if (! get_file(file.str_value.str, file.str_value.len, ">", -1, & ibuf, & obuf)
+	    || obuf == NULL) {
+		nonfatal(ext_id, _("json::write_json: cannot open `%s' for writing"), file.str_value.str);
+		if (errno == 0)
+			errno = EIO;
+		goto done;
+	}
+
+	{
+		GawkFileStream stream(obuf);
+		rapidjson::Writer<GawkFileStream> writer(stream);
+
+		// one document per line
+		if (write_array(writer, source.array_cookie, do_linear_arrays)) {
+			stream.Put('\n');
+			stream.Flush();
+			success = ! stream.failed();
+		}
+		if (stream.failed() && errno == 0)
+			errno = EIO;
+	}
+	if (! success && errno == 0)
+		errno = EINVAL;	// best guess
+
+done:
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+	return make_number(success, result);
+}
+
+
+/*  do_json_get --- the value a JSON Pointer names in a JSON text */
+
+static awk_value_t *
+do_json_get(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	awk_value_t text, pointer;
+	std::vector<json_pointer> pointers;
+
+	errno = 0;
+	make_null_string(result);
+
+	if (nargs < 2) {
+		if (do_lint)
+			lintwarn(ext_id, _("json::get: expecting at least two arguments, received %d"), nargs);
+		return result;
+	}
+
+	if (! get_argument(0, AWK_STRING, & text)) {
+		nonfatal(ext_id, _("json::get: first argument is not a string"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	pointers.resize(nargs - 1);
+	for (int i = 1; i < nargs; i++) {
+		if (! get_argument(i, AWK_STRING, & pointer)
+		    || ! parse_pointer(pointer.str_value.str, pointer.str_value.len, pointers[i-1])) {
+			nonfatal(ext_id, _("json::get: argument %d is not a JSON Pointer"), i + 1);
+			errno = EINVAL;
+			goto done;
+		}
+	}
+
+	// the first of the pointers that is there
+	if (find_pointers(text.str_value, pointers, true)) {
+		for (size_t i = 0; i < pointers.size(); i++) {
+			if (pointers[i].found) {
+				*result = pointers[i].value;
+				pointers[i].found = false;
+				break;
+			}
+		}
+	} else
+		errno = EINVAL;
+
+	for (size_t i = 0; i < pointers.size(); i++)
+		free_pointer_value(pointers[i]);
+
+done:
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+	return result;
+}
+
+/*  do_json_extract --- the values JSON Pointers name, into an array */
+
+static awk_value_t *
+do_json_extract(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	awk_value_t text, paths, out;
+	awk_flat_array_t *flat_array = NULL;
+	std::vector<json_pointer> pointers;
+	double count = -1;
+
+	errno = 0;
+	if (nargs != 3) {
+		if (do_lint)
+			lintwarn(ext_id, _("json::extract: expecting three arguments, received %d"), nargs);
+		goto out;
+	}
+
+	if (! get_argument(0, AWK_STRING, & text)) {
+		nonfatal(ext_id, _("json::extract: first argument is not a string"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (! get_argument(1, AWK_ARRAY, & paths)) {
+		nonfatal(ext_id, _("json::extract: second argument is not an array"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (! get_argument(2, AWK_ARRAY, & out)) {
+		nonfatal(ext_id, _("json::extract: third argument is not an array"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (! flatten_array_typed(paths.array_cookie, & flat_array, AWK_STRING, AWK_STRING)) {
+		nonfatal(ext_id, _("json::extract: could not flatten array"));
+		errno = ENOMEM;
+		goto done;
+	}
+
+	pointers.resize(flat_array->count);
+	for (size_t i = 0; i < flat_array->count; i++) {
+		const awk_string_t& path = flat_array->elements[i].value.str_value;
+
+		if (! parse_pointer(path.str, path.len, pointers[i])) {
+			nonfatal(ext_id, _("json::extract: `%s' is not a JSON Pointer"), path.str);
+			errno = EINVAL;
+			goto done;
+		}
+	}
+
+	if (! clear_array(out.array_cookie)) {
+		nonfatal(ext_id, _("json::extract: clear_array failed"));
+		errno = ENOMEM;
+		goto done;
+	}
+
+	if (! find_pointers(text.str_value, pointers, false)) {
+		errno = EINVAL;
+		goto done;
+	}
+
+	// the values go under the same subscripts as their pointers
+	count = 0;
+	for (size_t i = 0; i < pointers.size(); i++) {
+		const awk_string_t& sub = flat_array->elements[i].index.str_value;
+		awk_value_t index;
+
+		if (! pointers[i].found)
+			continue;
+		if (! set_array_element(out.array_cookie,
+				make_const_string(sub.str, sub.len, & index), & pointers[i].value)) {
+			errno = ENOMEM;
+			continue;
+		}
+		pointers[i].found = false;	// gawk has it now
+		count++;
+	}
+
+done:
+	for (size_t i = 0; i < pointers.size(); i++)
+		free_pointer_value(pointers[i]);
+
+	if (flat_array != NULL && ! release_flattened_array(paths.array_cookie, flat_array)) {
+		warning(ext_id, _("json::extract: could not release flattened array"));
+		errno = ENOMEM;
+	}
+
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+out:
+	return make_number(count, result);
+}
+
+/*  do_json_parse --- parse a JSON text, return a handle to the document */
+
+static awk_value_t *
+do_json_parse(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	awk_value_t text;
+	double handle = -1;
+
+	errno = 0;
+	if (! get_argument(0, AWK_STRING, & text)) {
+		nonfatal(ext_id, _("json::parse: first argument is not a string"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	{
+		rapidjson::Document *doc = new rapidjson::Document;
+		size_t len = text.str_value.len;
+		char *copy;
+
+		// Parse a copy in place, kept by the document's allocator:
+		// its strings then point into the copy instead of being
+		// copied one by one.
+		copy = (char *) doc->GetAllocator().Malloc(len + 1);
+		if (copy == NULL) {
+			delete doc;
+			errno = ENOMEM;
+			goto done;
+		}
+		memcpy(copy, text.str_value.str, len);
+		copy[len] = '\0';
+
+		if (doc->ParseInsitu(copy).HasParseError()) {
+			delete doc;
+			errno = EINVAL;
+		} else
+			handle = new_handle(doc);
+	}
+
+done:
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+	return make_number(handle, result);
+}
+
+/*  do_json_query --- the value a JSON Pointer names in a document */
+
+static awk_value_t *
+do_json_query(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	rapidjson::Document *doc;
+	const rapidjson::Value *value;
+	size_t slot;
+
+	errno = 0;
+	make_null_string(result);
+
+	if ((doc = get_document(0, "json::query", & slot)) != NULL
+	    && (value = get_value(doc, 1, "json::query")) != NULL)
+		make_json_value(*value, result);
+
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+	return result;
+}
+
+/*  do_json_size --- the number of members or elements of an object or array */
+
+static awk_value_t *
+do_json_size(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	rapidjson::Document *doc;
+	const rapidjson::Value *value;
+	size_t slot;
+	double length = -1;
+
+	errno = 0;
+	if ((doc = get_document(0, "json::size", & slot)) != NULL
+	    && (value = get_value(doc, 1, "json::size")) != NULL) {
+		if (value->IsObject())
+			length = value->MemberCount();
+		else if (value->IsArray())
+			length = value->Size();
+	}
+
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+	return make_number(length, result);
+}
+
+/*  do_json_keys --- the member names of an object, or the indices of an array */
+
+static awk_value_t *
+do_json_keys(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	rapidjson::Document *doc;
+	const rapidjson::Value *value;
+	awk_value_t keys, index, key;
+	size_t slot;
+	double count = -1;
+
+	errno = 0;
+	if ((doc = get_document(0, "json::keys", & slot)) == NULL
+	    || (value = get_value(doc, 1, "json::keys")) == NULL)
+		goto done;
+
+	if (! get_argument(2, AWK_ARRAY, & keys)) {
+		nonfatal(ext_id, _("json::keys: third argument is not an array"));
+		errno = EINVAL;
+		goto done;
+	}
+
+	if (! clear_array(keys.array_cookie)) {
+		nonfatal(ext_id, _("json::keys: clear_array failed"));
+		errno = ENOMEM;
+		goto done;
+	}
+
+	// keys[1] .. keys[N], in the order of the document
+	if (value->IsObject()) {
+		count = 0;
+		for (rapidjson::Value::ConstMemberIterator m = value->MemberBegin();
+		     m != value->MemberEnd(); ++m) {
+			count++;
+			make_const_string(m->name.GetString(), m->name.GetStringLength(), & key);
+			if (! set_array_element(keys.array_cookie, make_number(count, & index), & key)) {
+				errno = ENOMEM;
+				break;
+			}
+		}
+	} else if (value->IsArray()) {
+		// JSON array indices start at 0
+		for (count = 0; count < value->Size(); count++) {
+			if (! set_array_element(keys.array_cookie,
+					make_number(count + 1, & index), make_number(count, & key))) {
+				errno = ENOMEM;
+				break;
+			}
+		}
+	}
+
+done:
+	if (errno != 0)
+		update_ERRNO_int(errno);
+
+	return make_number(count, result);
+}
+
+/*  do_json_free --- release a document */
+
+static awk_value_t *
+do_json_free(int nargs, awk_value_t *result, awk_ext_func_t *unused)
+{
+	rapidjson::Document *doc;
+	size_t slot;
+
+	errno = 0;
+	if ((doc = get_document(0, "json::free", & slot)) == NULL) {
+		update_ERRNO_int(errno);
+		return make_number(0, result);
+	}
+
+	delete doc;
+	documents[slot] = NULL;
+	free_slots.push_back(slot);
+
+	return make_number(1, result);
+}
+
+/* bad_record --- report a record that is not valid JSON, and forget it */
+
+static void
+bad_record(awk_input_buf_t *iobuf, json_input *input, rapidjson::ParseErrorCode code, size_t offset)
+{
+	warning(ext_id, _("json: %s: record %lu: %s (offset %lu)"),
+		iobuf->name, input->record,
+		rapidjson::GetParseError_En(code), (unsigned long) offset);
+	clear_array(JSONREC);
+	input->fields->nf = 0;
+}
+
+/* json_get_record --- read a JSON line, decode it into JSONREC */
+
+static int
+json_get_record(char **out, awk_input_buf_t *iobuf, int *errcode,
+		char **rt_start, size_t *rt_len,
+		const awk_fieldwidth_info_t **field_width)
+{
+	json_input *input = (json_input *) iobuf->opaque;
+	json_input *fields = (input->mode == 2 ? input : NULL);
+	json_line line;
+	char *record, *eol;
+	size_t len, i;
+
+	if (input->pool != NULL) {
+		// parsed already
+		if (! json_pool_read(input->pool, iobuf, & line, errcode))
+			return EOF;
+		record = (char *) line.text;
+		len = line.len;
+		*rt_start = record + len;
+		*rt_len = line.rt_len;
+		goto decode;
+	}
+
+	// find the end of the line, reading more as needed
+	for (;;) {
+		eol = (char *) memchr(input->buf + input->start, '\n', input->end - input->start);
+		if (eol != NULL || input->eof)
+			break;
+		if (! fill_buffer(iobuf, input)) {
+			*errcode = errno;
+			return EOF;
+		}
+	}
+
+	record = input->buf + input->start;
+	if (eol != NULL) {
+		len = eol - record;
+		*rt_start = eol;
+		*rt_len = 1;
+		if (len > 0 && record[len - 1] == '\r') {
+			len--;
+			*rt_start = eol - 1;
+			*rt_len = 2;
+		}
+		input->start = eol + 1 - input->buf;
+	} else if (input->start < input->end) {
+		// last line, without a newline
+		len = input->end - input->start;
+		*rt_start = record + len;
+		*rt_len = 0;
+		input->start = input->end;
+	} else
+		return EOF;
+
+decode:
+	input->record++;
+	input->fields->nf = 0;
+	input->field_end = 0;
+	clear_array(JSONREC);
+
+	if (input->pool != NULL) {
+		if (line.tape != NULL) {
+			TapeStream stream;
+			RecordHandler<TapeStream> handler(JSONREC, record, stream, fields);
+
+			if (! play_tape(line.tape, line.tape_end, handler, stream))
+				bad_record(iobuf, input, rapidjson::kParseErrorTermination, stream.pos);
+		} else if (line.error != 0)
+			bad_record(iobuf, input, (rapidjson::ParseErrorCode) line.error, line.error_offset);
+		goto done;
+	}
+
+	// empty lines give an empty JSONREC
+	for (i = 0; i < len && (record[i] == ' ' || record[i] == '\t'); i++)
+		continue;
+	if (i < len) {
+		rapidjson::MemoryStream stream(record, len);
+		RecordHandler<rapidjson::MemoryStream> handler(JSONREC, record, stream, fields);
+		rapidjson::Reader reader;
+
+		if (! reader.Parse(stream, handler))
+			bad_record(iobuf, input, reader.GetParseErrorCode(), reader.GetErrorOffset());
+	}
+
+done:
+	*out = record;
+	*errcode = 0;
+	*field_width = (input->mode == 2 ? input->fields : NULL);
+
+	return len;
+}
+
+/* json_close --- free the input reader */
+
+static void
+json_close(awk_input_buf_t *iobuf)
+{
+	json_input *input = (json_input *) iobuf->opaque;
+
+	if (input->pool != NULL)
+		json_pool_stop(input->pool);
+	gawk_free(input->buf);
+	gawk_free(input->fields);
+	delete input;
+	iobuf->opaque = NULL;
+}
+
+/* json_can_take_file --- take any file if JSONMODE is set */
+
+static awk_bool_t
+json_can_take_file(const awk_input_buf_t *iobuf)
+{
+	awk_value_t mode, threads;
+
+	if (JSONREC == NULL || iobuf->fd < 0
+	    || ! sym_lookup("JSONMODE", AWK_NUMBER, & mode))
+		return awk_false;
+
+	json_mode = (int) mode.num_value;
+	json_threads = 0;
+	if (sym_lookup("JSONTHREADS", AWK_NUMBER, & threads) && threads.num_value >= 1)
+		json_threads = (threads.num_value < JSON_MAX_THREADS
+				? (int) threads.num_value : JSON_MAX_THREADS);
+	return (json_mode != 0 ? awk_true : awk_false);
+}
+
+/* json_take_control_of --- set up the input reader */
+
+static awk_bool_t
+json_take_control_of(awk_input_buf_t *iobuf)
+{
+	json_input *input = new json_input();
+
+	input->size = JSON_INPUT_BUFSIZE;
+	input->buf = (char *) gawk_malloc(input->size);
+	input->mode = json_mode;
+	input->max_fields = 16;
+	input->fields = (awk_fieldwidth_info_t *) gawk_malloc(fields_size(input->max_fields));
+	if (input->buf == NULL || input->fields == NULL) {
+		warning(ext_id, _("json: %s: out of memory, JSONMODE ignored"), iobuf->name);
+		gawk_free(input->buf);
+		gawk_free(input->fields);
+		delete input;
+		return awk_false;
+	}
+	input->fields->use_chars = awk_false;
+	input->fields->nf = 0;
+
+	// without threads, or if they cannot start, gawk parses
+	input->pool = json_pool_start(json_threads);
+
+	iobuf->opaque = input;
+	iobuf->get_record = json_get_record;
+	iobuf->close_func = json_close;
+
+	return awk_true;
+}
+
+static awk_input_parser_t json_parser = {
+	"json",
+	json_can_take_file,
+	json_take_control_of,
+	NULL
+};
+
+
+/*
+ * N.B. the 3rd value in the awk_ext_func_t struct called num_expected_args is
+ * actually the maximum number of allowed args. A better name would be
+ * max_allowed_args.
+ */
+static awk_ext_func_t func_table[] = {
+	{ "to_json",   do_json_toJSON,   2, 1 },
+	{ "from_json", do_json_fromJSON, 3, 2 },
+	{ "write_json", do_json_writeJSON, 3, 2 },
+	{ "get",       do_json_get,      16, 2 },	// up to 15 pointers
+	{ "extract",   do_json_extract,  3, 3 },
+	{ "parse",     do_json_parse,    1, 1 },
+	{ "query",     do_json_query,    2, 2 },
+	{ "size",      do_json_size,     2, 2 },	// length() is built in
+	{ "keys",      do_json_keys,     3, 3 },
+	{ "free",      do_json_free,     1, 1 },
+};
+
+static awk_bool_t
+init_my_module(void)
+{
+	GAWKEXTLIB_COMMON_INIT
+
+	// the array for JSONMODE input
+	awk_value_t val;
+	val.val_type = AWK_ARRAY;
+	val.array_cookie = create_array();
+	if (sym_update("JSONREC", & val))
+		JSONREC = val.array_cookie;	// the one installed by sym_update
+	else
+		warning(ext_id, _("json: JSONREC is already used, JSONMODE will not work"));
+
+	register_input_parser(& json_parser);
 	return awk_true;
 }
 
@@ -0,0 +1,478 @@
+/*
+ * jsonthreads.cpp - Parse JSON Lines input ahead of gawk with several threads.
+ */
+
+/*
+ * Copyright (C) 2026 the Free Software Foundation, Inc.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1335, USA
+ */
+
+/*
+ * The gawk thread reads the input in chunks of whole lines, and puts
+ * them in a bounded queue. Worker threads take the chunks in turn, and
+ * parse each line of a chunk into a tape. The gawk thread takes the
+ * chunks back in order, and plays the tapes of their lines into the
+ * arrays, which is the only part that needs the gawk API. So while gawk
+ * works on the records of one chunk, the next ones are being parsed.
+ *
+ * A JSON text cannot have a newline inside a string, so chunks can be
+ * cut after any newline, and the records are the same as those read by
+ * a single thread.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "gawkapi.h"
+#include "rapidjson/memorystream.h"
+#include "jsonthreads.h"
+
+#ifdef JSON_USE_THREADS
+
+#include <pthread.h>
+#include <poll.h>
+
+// Chunk states
+#define CHUNK_FREE	0
+#define CHUNK_READY	1	// read, waiting for a worker
+#define CHUNK_BUSY	2
+#define CHUNK_DONE	3
+
+// A line of a chunk, kept until delivered
+struct chunk_line {
+	size_t		start;		// the line, in the text of the chunk
+	size_t		len;
+	size_t		rt_len;
+	size_t		tape;		// its events, in the tape of the chunk
+	size_t		tape_end;
+	int		error;		// rapidjson::ParseErrorCode, 0 if none
+	size_t		error_offset;
+};
+
+// Whole lines of input, and the tapes of their parsing
+struct json_chunk {
+	int		state;		// CHUNK_FREE, CHUNK_READY, CHUNK_BUSY or CHUNK_DONE
+	char		*text;		// the lines, with their terminators
+	size_t		len;		// length of the above
+	size_t		size;		// size of the buffer
+	std::vector<chunk_line> lines;
+	std::vector<char> tape;		// the events of all the lines
+};
+
+struct json_pool {
+	json_chunk	*slots;		// bounded queue of chunks, chunk k in slot k % nslots
+	size_t		nslots;
+	pthread_t	*threads;
+	int		nthreads;
+
+	pthread_mutex_t	lock;
+	pthread_cond_t	work_cv;	// a chunk has been read
+	pthread_cond_t	done_cv;	// a chunk has been parsed
+	size_t		next;		// next chunk to read
+	size_t		work;		// next chunk to give to a worker
+	bool		shutdown;
+
+	// only used by the gawk thread
+	size_t		cur;		// chunk being delivered
+	bool		ready;		// the current chunk has been parsed
+	size_t		line;		// next line to deliver
+	char		*rest;		// input after the last whole line read
+	size_t		rest_len;
+	size_t		rest_size;
+	bool		eof;
+	int		error;		// errno of a failed read, 0 if none
+};
+
+// TapeWriter --- keep the calls of the reader as events in a tape
+
+struct TapeWriter :
+public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, TapeWriter> {
+	TapeWriter(std::vector<char>& tape, const rapidjson::MemoryStream& stream)
+	: m_tape(tape),
+	  m_stream(stream)
+	{
+		memset(& m_event, 0, sizeof(m_event));
+	}
+
+	bool Null()			{ return put(TAPE_NULL); }
+	bool Bool(bool b)		{ return put(b ? TAPE_TRUE : TAPE_FALSE); }
+	bool Int(int i)			{ m_event.v.i = i; return put(TAPE_INT); }
+	bool Uint(unsigned u)		{ m_event.v.u = u; return put(TAPE_UINT); }
+	bool Int64(int64_t i)		{ m_event.v.i = i; return put(TAPE_INT64); }
+	bool Uint64(uint64_t u)		{ m_event.v.u = u; return put(TAPE_UINT64); }
+	bool Double(double d)		{ m_event.v.d = d; return put(TAPE_DOUBLE); }
+
+	bool String(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		m_event.v.count = length;
+		put(TAPE_STRING);
+		m_tape.insert(m_tape.end(), str, str + length);
+		return true;
+	}
+
+	bool Key(const char* str, rapidjson::SizeType length, bool copy)
+	{
+		m_event.v.count = length;
+		put(TAPE_KEY);
+		m_tape.insert(m_tape.end(), str, str + length);
+		return true;
+	}
+
+	bool StartObject()		{ return put(TAPE_START_OBJECT); }
+	bool StartArray()		{ return put(TAPE_START_ARRAY); }
+
+	bool EndObject(rapidjson::SizeType memberCount)
+	{
+		m_event.v.count = memberCount;
+		return put(TAPE_END_OBJECT);
+	}
+
+	bool EndArray(rapidjson::SizeType elementCount)
+	{
+		m_event.v.count = elementCount;
+		return put(TAPE_END_ARRAY);
+	}
+
+private:
+	// put --- add an event
+	bool put(tape_type type)
+	{
+		const char *ev = (const char *) & m_event;
+
+		m_event.type = type;
+		m_event.pos = m_stream.Tell();
+		m_tape.insert(m_tape.end(), ev, ev + sizeof(m_event));
+		return true;
+	}
+
+	std::vector<char>& m_tape;
+	const rapidjson::MemoryStream& m_stream;
+	tape_event	m_event;
+};
+
+/* parse_chunk --- parse each line of a chunk into the tape */
+
+static void
+parse_chunk(json_chunk *c)
+{
+	size_t pos = 0, next, i;
+
+	c->lines.clear();
+	c->tape.clear();
+
+	while (pos < c->len) {
+		const char *record = c->text + pos;
+		const char *eol = (const char *) memchr(record, '\n', c->len - pos);
+		chunk_line line;
+
+		// as json_get_record() does
+		line.start = pos;
+		if (eol != NULL) {
+			line.len = eol - record;
+			line.rt_len = 1;
+			if (line.len > 0 && record[line.len - 1] == '\r') {
+				line.len--;
+				line.rt_len = 2;
+			}
+			next = eol + 1 - c->text;
+		} else {
+			line.len = c->len - pos;
+			line.rt_len = 0;
+			next = c->len;
+		}
+		line.tape = line.tape_end = c->tape.size();
+		line.error = 0;
+		line.error_offset = 0;
+
+		for (i = 0; i < line.len && (record[i] == ' ' || record[i] == '\t'); i++)
+			continue;
+		if (i < line.len) {
+			rapidjson::MemoryStream stream(record, line.len);
+			TapeWriter writer(c->tape, stream);
+			rapidjson::Reader reader;
+
+			if (! reader.Parse(stream, writer)) {
+				line.error = reader.GetParseErrorCode();
+				line.error_offset = reader.GetErrorOffset();
+				c->tape.resize(line.tape);
+			}
+			line.tape_end = c->tape.size();
+		}
+
+		c->lines.push_back(line);
+		pos = next;
+	}
+}
+
+/* worker --- thread body: parse the chunks as they are read */
+
+static void *
+worker(void *arg)
+{
+	json_pool_p pool = (json_pool_p) arg;
+	json_chunk *c;
+
+	pthread_mutex_lock(& pool->lock);
+	for (;;) {
+		while (! pool->shutdown && pool->work == pool->next)
+			pthread_cond_wait(& pool->work_cv, & pool->lock);
+		if (pool->shutdown)
+			break;
+		c = & pool->slots[pool->work++ % pool->nslots];
+		c->state = CHUNK_BUSY;
+		pthread_mutex_unlock(& pool->lock);
+
+		parse_chunk(c);
+
+		pthread_mutex_lock(& pool->lock);
+		c->state = CHUNK_DONE;
+		pthread_cond_broadcast(& pool->done_cv);
+	}
+	pthread_mutex_unlock(& pool->lock);
+
+	return NULL;
+}
+
+/* grow --- make room for more in a buffer, false if out of memory */
+
+static bool
+grow(char **buf, size_t *size, size_t needed)
+{
+	size_t new_size = (*size > 0 ? *size : JSON_CHUNK_SIZE);
+	char *p;
+
+	while (new_size < needed)
+		new_size *= 2;
+	if (new_size == *size)
+		return true;
+	if ((p = (char *) realloc(*buf, new_size)) == NULL)
+		return false;
+	*buf = p;
+	*size = new_size;
+	return true;
+}
+
+/*
+ * read_chunk --- read whole lines into a chunk, in the gawk thread.
+ * Stop when the chunk is large enough, or after a short read, when the
+ * input has no more for now. Return false if there is nothing more.
+ */
+
+static bool
+read_chunk(json_pool_p pool, awk_input_buf_t *iobuf, json_chunk *c)
+{
+	size_t whole = 0;	// end of the last whole line
+	ssize_t n;
+
+	// the partial line left over comes first
+	if (! grow(& c->text, & c->size, pool->rest_len + JSON_CHUNK_SIZE)) {
+		pool->error = ENOMEM;
+		pool->eof = true;
+		return false;
+	}
+	if (pool->rest_len > 0)
+		memcpy(c->text, pool->rest, pool->rest_len);
+	c->len = pool->rest_len;
+	pool->rest_len = 0;
+
+	while (! pool->eof) {
+		if (c->len == c->size && ! grow(& c->text, & c->size, 2 * c->size)) {
+			pool->error = ENOMEM;
+			pool->eof = true;
+			break;
+		}
+
+		size_t want = c->size - c->len;
+		n = iobuf->read_func(iobuf->fd, c->text + c->len, want);
+		if (n <= 0) {
+			if (n < 0)
+				pool->error = errno;
+			pool->eof = true;
+			break;
+		}
+
+		for (size_t i = c->len + n; i > c->len; i--) {
+			if (c->text[i - 1] == '\n') {
+				whole = i;
+				break;
+			}
+		}
+		c->len += n;
+
+		if (whole > 0 && (c->len >= JSON_CHUNK_SIZE || (size_t) n < want))
+			break;
+	}
+
+	// keep the partial last line for the next chunk
+	if (! pool->eof && whole < c->len) {
+		size_t rest = c->len - whole;
+
+		if (! grow(& pool->rest, & pool->rest_size, rest)) {
+			pool->error = ENOMEM;
+			pool->eof = true;
+		} else {
+			memcpy(pool->rest, c->text + whole, rest);
+			pool->rest_len = rest;
+			c->len = whole;
+		}
+	}
+
+	return c->len > 0;
+}
+
+/* input_waiting --- true if a read would not block, or if we cannot tell */
+
+static bool
+input_waiting(int fd)
+{
+	struct pollfd p;
+
+	p.fd = fd;
+	p.events = POLLIN;
+	p.revents = 0;
+	return poll(& p, 1, 0) != 0;
+}
+
+#endif /* JSON_USE_THREADS */
+
+
+/* json_pool_start --- start parsing input ahead with nthreads threads, NULL if not possible */
+
+json_pool_p
+json_pool_start(int nthreads)
+{
+#ifdef JSON_USE_THREADS
+	json_pool_p pool;
+
+	if (nthreads < 1)
+		return NULL;
+	if (nthreads > JSON_MAX_THREADS)
+		nthreads = JSON_MAX_THREADS;
+
+	pool = new json_pool();
+	pool->nslots = 2 * nthreads;
+	pool->slots = new json_chunk[pool->nslots]();
+	pool->threads = new pthread_t[nthreads];
+
+	pthread_mutex_init(& pool->lock, NULL);
+	pthread_cond_init(& pool->work_cv, NULL);
+	pthread_cond_init(& pool->done_cv, NULL);
+	for (int k = 0; k < nthreads; k++) {
+		if (pthread_create(& pool->threads[pool->nthreads], NULL, worker, pool) != 0)
+			break;
+		pool->nthreads++;
+	}
+	if (pool->nthreads == 0) {
+		json_pool_stop(pool);
+		return NULL;
+	}
+	return pool;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * json_pool_read --- deliver the next line and its tape. It stays valid
+ * until the next call. Return false at the end of the input, with
+ * errcode set if a read failed.
+ */
+
+bool
+json_pool_read(json_pool_p pool, awk_input_buf_t *iobuf, json_line *line, int *errcode)
+{
+#ifdef JSON_USE_THREADS
+	json_chunk *c;
+
+	for (;;) {
+		c = & pool->slots[pool->cur % pool->nslots];
+		if (pool->ready) {
+			if (pool->line < c->lines.size())
+				break;
+
+			// chunk delivered, give its slot back
+			pool->cur++;
+			pool->ready = false;
+			continue;
+		}
+
+		// read ahead into the free slots, but once the current chunk
+		// is queued, do not wait for input that is typed or piped in
+		// slowly: its first lines must come through
+		while (! pool->eof && pool->next < pool->cur + pool->nslots) {
+			json_chunk *r = & pool->slots[pool->next % pool->nslots];
+
+			if (pool->next > pool->cur && ! input_waiting(iobuf->fd))
+				break;
+			if (! read_chunk(pool, iobuf, r))
+				break;
+			pthread_mutex_lock(& pool->lock);
+			r->state = CHUNK_READY;
+			pool->next++;
+			pthread_cond_signal(& pool->work_cv);
+			pthread_mutex_unlock(& pool->lock);
+		}
+		if (pool->cur == pool->next) {
+			*errcode = pool->error;
+			return false;
+		}
+
+		pthread_mutex_lock(& pool->lock);
+		while (c->state != CHUNK_DONE)
+			pthread_cond_wait(& pool->done_cv, & pool->lock);
+		c->state = CHUNK_FREE;
+		pthread_mutex_unlock(& pool->lock);
+		pool->ready = true;
+		pool->line = 0;
+	}
+
+	const chunk_line& l = c->lines[pool->line++];
+
+	line->text = c->text + l.start;
+	line->len = l.len;
+	line->rt_len = l.rt_len;
+	line->tape = (l.tape < l.tape_end ? & c->tape[l.tape] : NULL);
+	line->tape_end = (l.tape < l.tape_end ? & c->tape[0] + l.tape_end : NULL);
+	line->error = l.error;
+	line->error_offset = l.error_offset;
+	*errcode = 0;
+	return true;
+#else
+	*errcode = 0;
+	return false;
+#endif
+}
+
+/* json_pool_stop --- stop the threads and free memory */
+
+void
+json_pool_stop(json_pool_p pool)
+{
+#ifdef JSON_USE_THREADS
+	pthread_mutex_lock(& pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(& pool->work_cv);
+	pthread_mutex_unlock(& pool->lock);
+
+	for (int k = 0; k < pool->nthreads; k++)
+		pthread_join(pool->threads[k], NULL);
+
+	pthread_mutex_destroy(& pool->lock);
+	pthread_cond_destroy(& pool->work_cv);
+	pthread_cond_destroy(& pool->done_cv);
+	for (size_t k = 0; k < pool->nslots; k++)
+		free(pool->slots[k].text);
+	free(pool->rest);
+	delete[] pool->slots;
+	delete[] pool->threads;
+	delete pool;
+#endif
+}
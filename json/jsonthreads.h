@@ -0,0 +1,123 @@
+/*
+ * jsonthreads.h - Parse JSON Lines input ahead of gawk with several threads.
+ */
+
+/*
+ * Copyright (C) 2026 the Free Software Foundation, Inc.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1335, USA
+ */
+
+// NOTE: You must include "gawkapi.h" before this file
+
+#ifndef JSONTHREADS_H__
+#define JSONTHREADS_H__
+
+#include <vector>
+#include "rapidjson/reader.h"
+
+#ifdef HAVE_PTHREAD_H
+#define JSON_USE_THREADS 1
+#endif
+
+#define JSON_MAX_THREADS	256	// upper limit of JSONTHREADS
+#ifndef JSON_CHUNK_SIZE
+#define JSON_CHUNK_SIZE		(256 * 1024)	// input given to a thread at once
+#endif
+
+// A tape is what the reader told its handler while parsing a record,
+// as a list of events in memory. Each event notes where the stream was
+// after it, so that playing it back to a handler looks the same as
+// parsing. The gawk API may only be used from the gawk thread: the
+// workers parse into tapes, and the gawk thread plays them back into
+// the arrays.
+
+enum tape_type {
+	TAPE_NULL, TAPE_FALSE, TAPE_TRUE,
+	TAPE_INT, TAPE_UINT, TAPE_INT64, TAPE_UINT64, TAPE_DOUBLE,
+	TAPE_STRING, TAPE_KEY,		// followed by the chars
+	TAPE_START_OBJECT, TAPE_END_OBJECT,
+	TAPE_START_ARRAY, TAPE_END_ARRAY
+};
+
+struct tape_event {
+	unsigned char	type;		// a tape_type
+	size_t		pos;		// position of the stream after it
+	union {
+		int64_t		i;
+		uint64_t	u;
+		double		d;
+		rapidjson::SizeType count;	// length, members or elements
+	} v;
+};
+
+// TapeStream --- the position of the stream while a tape is played
+struct TapeStream {
+	TapeStream() : pos(0) { }
+	size_t Tell() const	{ return pos; }
+
+	size_t pos;
+};
+
+// play_tape --- give the events of a tape to a handler, in order
+
+template <typename Handler>
+bool play_tape(const char *tape, const char *end, Handler& handler, TapeStream& stream)
+{
+	tape_event ev;
+	bool ok = true;
+
+	while (ok && tape < end) {
+		memcpy(& ev, tape, sizeof(ev));	// events are not aligned
+		tape += sizeof(ev);
+		stream.pos = ev.pos;
+
+		switch (ev.type) {
+		case TAPE_NULL:		ok = handler.Null(); break;
+		case TAPE_FALSE:	ok = handler.Bool(false); break;
+		case TAPE_TRUE:		ok = handler.Bool(true); break;
+		case TAPE_INT:		ok = handler.Int((int) ev.v.i); break;
+		case TAPE_UINT:		ok = handler.Uint((unsigned) ev.v.u); break;
+		case TAPE_INT64:	ok = handler.Int64(ev.v.i); break;
+		case TAPE_UINT64:	ok = handler.Uint64(ev.v.u); break;
+		case TAPE_DOUBLE:	ok = handler.Double(ev.v.d); break;
+		case TAPE_STRING:
+			ok = handler.String(tape, ev.v.count, true);
+			tape += ev.v.count;
+			break;
+		case TAPE_KEY:
+			ok = handler.Key(tape, ev.v.count, true);
+			tape += ev.v.count;
+			break;
+		case TAPE_START_OBJECT:	ok = handler.StartObject(); break;
+		case TAPE_END_OBJECT:	ok = handler.EndObject(ev.v.count); break;
+		case TAPE_START_ARRAY:	ok = handler.StartArray(); break;
+		case TAPE_END_ARRAY:	ok = handler.EndArray(ev.v.count); break;
+		default:		ok = false; break;
+		}
+	}
+
+	return ok;
+}
+
+// A record, as delivered to the gawk thread
+struct json_line {
+	const char	*text;		// the record, without its terminator
+	size_t		len;		// its length
+	size_t		rt_len;		// length of the terminator, 0 at the end
+	const char	*tape;		// its events, NULL if empty or not valid
+	const char	*tape_end;
+	int		error;		// rapidjson::ParseErrorCode, 0 if none
+	size_t		error_offset;	// where it happened
+};
+
+typedef struct json_pool * json_pool_p;
+
+// Function prototypes
+json_pool_p json_pool_start(int nthreads);
+bool json_pool_read(json_pool_p pool, awk_input_buf_t *iobuf, json_line *line, int *errcode);
+void json_pool_stop(json_pool_p pool);
+
+#endif
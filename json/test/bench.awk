@@ -0,0 +1,80 @@
+# Measure json::from_json(), json::to_json() and json::parse() on a
+# large generated document
+#   -v shape=SHAPE   one of:
+#      records    an array of small objects, as in a log
+#      numbers    an array of numbers
+#      object     one object with many string members
+#      text       an array of long strings, some with escapes
+#      indented   the records, with a newline and indentation
+#                 after each comma, as written by people
+#   -v n=N           number of elements, default 100000
+#   -v reps=R        number of runs of each, default 5
+# Prints one line per function with MB/s of JSON text and documents/s.
+# Run it with gawk built with and without --enable-simd to compare.
+@load "json"
+@load "time"
+BEGIN {
+	if (n == "") n = 100000
+	if (reps == "") reps = 5
+	if (shape == "records" || shape == "indented") {
+		split("info warn error debug", levels)
+		for (k = 1; k <= n; k++) {
+			data[k]["id"] = k
+			data[k]["level"] = levels[k % 4 + 1]
+			data[k]["host"] = "web" (k % 8)
+			data[k]["msg"] = "request " k " served"
+			data[k]["ms"] = (k % 1000) / 8
+			data[k]["tags"][1] = "a"
+			data[k]["tags"][2] = "b"
+		}
+	} else if (shape == "numbers") {
+		for (k = 1; k <= n; k++)
+			data[k] = (k * 7919) % 1000003
+	} else if (shape == "object") {
+		for (k = 1; k <= n; k++)
+			data["k" k] = "value " k
+	} else if (shape == "text") {
+		line = "The quick brown fox jumps over the lazy dog. "
+		line = line line line line
+		for (k = 1; k <= n; k++)
+			data[k] = (k % 4 == 0 ? "\"" line "\"\t" k "\n" : line k)
+	} else {
+		print "bench: unknown shape `" shape "'" > "/dev/stderr"
+		exit 1
+	}
+	doc = json::to_json(data, 1)
+	if (shape == "indented")
+		gsub(/,/, ",\n        ", doc)	# no commas in the strings
+	bytes = length(doc)	# the tests run in the C locale
+
+	t0 = gettimeofday()
+	for (k = 1; k <= reps; k++) {
+		if (! json::from_json(doc, result)) {
+			print "bench: json::from_json failed: " ERRNO > "/dev/stderr"
+			exit 1
+		}
+	}
+	report("from_json", bytes, gettimeofday() - t0)
+
+	t0 = gettimeofday()
+	for (k = 1; k <= reps; k++)
+		out = json::to_json(data, 1)
+	report("to_json", length(out), gettimeofday() - t0)
+
+	t0 = gettimeofday()
+	for (k = 1; k <= reps; k++) {
+		if ((h = json::parse(doc)) < 0) {
+			print "bench: json::parse failed: " ERRNO > "/dev/stderr"
+			exit 1
+		}
+		json::free(h)
+	}
+	report("parse", bytes, gettimeofday() - t0)
+}
+
+function report(what, bytes, t)
+{
+	if (t <= 0) t = 1e-6
+	printf("%-10s %-9s %9.2f MB/s %9.2f docs/s\n",
+	       shape, what, bytes * reps / t / 1e6, reps / t)
+}
@@ -0,0 +1,28 @@
+BEGIN {
+	text = "{\"id\": 7, \"user\": {\"name\": \"ann\", \"tags\": [\"a\", \"b\", {\"x\": [1, 2.5]}]}, \"a/b\": true, \"n\": null}"
+
+	if ((doc = json::parse(text)) < 0) {
+		printf("json::parse(\"%s\") failed: %s\n", text, ERRNO) > "/dev/stderr"
+		exit 1
+	}
+
+	print "id:", json::query(doc, "/id")
+	print "name:", json::query(doc, "/user/name")
+	print "tags/2:", json::query(doc, "/user/tags/2")
+	print "x/1:", json::query(doc, "/user/tags/2/x/1")
+	print "a/b:", json::query(doc, "/a~1b")
+	print "n:", typeof(json::query(doc, "/n"))
+	print "missing:", typeof(json::query(doc, "/missing"))
+
+	print "size:", json::size(doc, ""), json::size(doc, "/user/tags"), json::size(doc, "/id")
+
+	n = json::keys(doc, "", keys)
+	for (i = 1; i <= n; i++)
+		printf("key %d: %s\n", i, keys[i])
+	n = json::keys(doc, "/user/tags", keys)
+	for (i = 1; i <= n; i++)
+		printf("tag %s: %s\n", keys[i], json::query(doc, "/user/tags/" keys[i]))
+
+	print "free:", json::free(doc)
+	print "bad text:", json::parse("[1,")
+}
@@ -0,0 +1,34 @@
+function dump(arr, prefix,	i)
+{
+	for (i in arr) {
+		if (isarray(arr[i]))
+			dump(arr[i], prefix "[" i "]")
+		else
+			printf("%s[%s] = %s\n", prefix, i, arr[i])
+	}
+}
+
+BEGIN {
+	PROCINFO["sorted_in"] = "@ind_str_asc"
+	text = "{\"id\": 7, \"user\": {\"name\": \"ann\", \"tags\": [\"a\", {\"x\": [1, 2]}, \"c\"]}, " \
+		"\"payload\": {\"raw\": [1, 2, {\"deep\": [[3]]}], \"trace\": \"long text\"}, \"ok\": true}"
+
+	print "depth 1:", json::from_json(text, a, 1)
+	dump(a, "a")
+	print "depth 2:", json::from_json(text, a, 2)
+	dump(a, "a")
+
+	want[1] = "/id"
+	want[2] = "/user/tags/1"
+	want[3] = "/payload/trace"
+	print "pointers:", json::from_json(text, a, want)
+	dump(a, "a")
+
+	split("", want)
+	want[1] = "/user/tags/2"
+	print "one element:", json::from_json(text, a, want)
+	dump(a, "a")
+
+	want[1] = "bad"
+	print "bad pointer:", json::from_json(text, a, want)
+}
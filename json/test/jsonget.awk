@@ -0,0 +1,25 @@
+BEGIN {
+	text = "{\"id\": 7, \"user\": {\"name\": \"ann\", \"tags\": [\"a\", \"b\", {\"x\": [1, 2]}]}, " \
+		"\"a/b\": 1, \"m~n\": 2, \"payload\": {\"big\": [1, 2, {\"y\": null}]}, \"ok\": true, \"n\": null}"
+
+	n = split("/id /user/name /user/tags/1 /user/tags/2/x/1 /user/tags/2 " \
+		  "/user/tags/01 /user/tags/3 /a~1b /m~0n /payload /ok /missing", ptrs, " ")
+	for (i = 1; i <= n; i++)
+		printf("%s: <%s>\n", ptrs[i], json::get(text, ptrs[i]))
+
+	print "fallback:", json::get(text, "/missing", "/user/name", "/id")
+	print "null:", typeof(json::get(text, "/n"))
+	print "missing:", typeof(json::get(text, "/missing"))
+
+	want["name"] = "/user/name"
+	want["x"] = "/user/tags/2/x"
+	want["x0"] = "/user/tags/2/x/0"
+	want["none"] = "/none"
+	got["old"] = 1
+	print "extract:", json::extract(text, want, got)
+	PROCINFO["sorted_in"] = "@ind_str_asc"
+	for (i in got)
+		printf("%s: <%s>\n", i, got[i])
+
+	print "bad text:", json::extract("[1,", want, got), length(got)
+}
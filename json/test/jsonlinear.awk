@@ -0,0 +1,17 @@
+BEGIN {
+	for (k = 10; k >= 1; k--)
+		a[k] = k
+	print json::to_json(a, 1)
+
+	split("", b)
+	print json::to_json(b, 1)
+
+	c["01"] = 1
+	print json::to_json(c, 1)
+
+	d[2] = "y"
+	print json::to_json(d, 1)
+
+	e["1.0"] = "z"
+	print json::to_json(e, 1)
+}
@@ -0,0 +1,22 @@
+BEGIN {
+	JSONMODE = 2
+	PROCINFO["sorted_in"] = "@ind_str_asc"
+}
+
+{
+	printf("%d: NF = %d:", FNR, NF)
+	for (i = 1; i <= NF; i++)
+		printf(" <%s>", $i)
+	print ""
+	dump(JSONREC, "")
+}
+
+function dump(a, prefix,	k)
+{
+	for (k in a) {
+		if (isarray(a[k]))
+			dump(a[k], prefix k ".")
+		else
+			printf("\t%s%s = %s\n", prefix, k, a[k])
+	}
+}
@@ -0,0 +1,7 @@
+BEGIN {
+	text = "{\"m\":[[1,2],[3,[4]],\"@/\",\"x\",\"x\",\"x\"]}"
+	if (json::from_json(text, a))
+		print json::to_json(a, 1)
+	else
+		printf("json::from_json(\"%s\") failed: %s\n", text, ERRNO) > "/dev/stderr"
+}
@@ -0,0 +1,24 @@
+# Dump the records of a large JSON Lines file, with the length of RT,
+# to compare the output with and without JSONTHREADS
+BEGIN {
+	JSONMODE = 2
+	PROCINFO["sorted_in"] = "@ind_str_asc"
+}
+
+{
+	printf("%d: RT = %d, NF = %d:", FNR, length(RT), NF)
+	for (i = 1; i <= NF; i++)
+		printf(" <%s>", $i)
+	print ""
+	dump(JSONREC, "")
+}
+
+function dump(a, prefix,	k)
+{
+	for (k in a) {
+		if (isarray(a[k]))
+			dump(a[k], prefix k ".")
+		else
+			printf("\t%s%s = %s\n", prefix, k, a[k])
+	}
+}
@@ -0,0 +1,23 @@
+BEGIN {
+	file = "jsonwrite.out"
+
+	t[1] = "x"
+	t[2]["a"] = 1
+	split("p q", t[3])
+	if (! json::write_json(t, file, 1))
+		printf("json::write_json failed: %s\n", ERRNO)
+
+	delete t
+	t["big"] = 2 ^ 40
+	if (! json::write_json(t, file))
+		printf("json::write_json failed: %s\n", ERRNO)
+	close(file)
+
+	while ((getline line < file) > 0) {
+		if (json::from_json(line, back))
+			print line
+		else
+			printf("json::from_json(\"%s\") failed: %s\n", line, ERRNO)
+	}
+	close(file)
+}
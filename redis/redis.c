@@ -32,9 +32,6 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
-#define TOPC   100 //Top Connection
-#define INCRPIPE   1000 //the pipeline increments
-
 char **mem_cdo(char **,const char *,int);
 char *mem_str(char **,const char *,int);
 void  free_mem_str(char **,int);
@@ -113,6 +110,8 @@ awk_value_t * tipoMget(int,awk_value_t *,const char *);
 awk_value_t * tipoHmget(int,awk_value_t *,const char *);
 awk_value_t * tipoSort(int,awk_value_t *,const char *);
 awk_value_t * tipoSortLimit(int,awk_value_t *,const char *);
+awk_value_t * tipoCommand(int,awk_value_t *,const char *);
+awk_value_t * tipoStats(int,awk_value_t *,const char *);
 
 awk_value_t * processREPLY(awk_array_t *,awk_value_t *,redisContext *,const char *);
 
@@ -125,12 +124,36 @@ int theReplyArrayS(awk_array_t);
 int theReplyToArray(awk_array_t,const char*,const char);
 int theReplyArray(awk_array_t, enum resultArray, size_t);
 int theReplyArrayK1(awk_array_t, redisReply *);
+int theReplyTree(awk_array_t, redisReply *);
 int theReplyArray1(awk_array_t, enum resultArray, size_t);
 int theReplyScan(awk_array_t,char *);
 
-static  long long pipel[TOPC][2];
+/*
+ * The handles given to awk index a table that grows as needed. A handle
+ * is a connection, or a pipeline of one; the free ones are kept in a
+ * list, so that making one and looking it up take constant time.
+ */
+struct connection {
+  int used;
+  redisContext *ctx;     /* for a connection */
+  int conn;              /* for a pipeline, its connection, else -1 */
+  int pipe;              /* for a connection, its pipeline, else -1 */
+  long long pending;     /* replies buffered in the pipeline */
+  long long calls;       /* functions called with it or its pipeline */
+  long long errors;      /* error replies and connection errors */
+  char *host;
+  int port;
+  int next_free;
+};
+
+static  struct connection *conns;
+static  int nconns;         /* size of the table */
+static  int free_conns=-1;  /* first free handle */
+static  int cur_conn=-1;    /* handle of the function called */
 
-static  redisContext *c[TOPC];
+int new_handle(void);
+void free_handle(int);
+void drop_conn(int);
 static  redisReply *reply;
 static const gawk_api_t *api;	/* for convenience macros to work */
 static awk_ext_id_t ext_id;
@@ -163,10 +186,9 @@ static awk_value_t * do_disconnect(int nargs __UNUSED_V2, awk_value_t *result AP
      return make_number(ret, result);
     }
     ival=val.num_value;
-    if(ival >= 0 && ival < TOPC) {
-     if(c[ival]!=NULL) {
-       redisFree(c[ival]);
-       c[ival]=(redisContext *)NULL;
+    if(ival >= 0 && ival < nconns) {
+     if(conns[ival].used && conns[ival].ctx!=NULL) {
+       drop_conn(ival);
        ret=1;
      }
      else {
@@ -188,11 +210,11 @@ static awk_value_t * do_disconnect(int nargs __UNUSED_V2, awk_value_t *result AP
 
 redisReply * rCommand(int tcdo, int ind, int count, const char ** sts) {
    if(tcdo==-1)  {
-     return redisCommandArgv(c[ind],count,sts,NULL);
+     return redisCommandArgv(conns[ind].ctx,count,sts,NULL);
    }
    else {
-     redisAppendCommandArgv(c[tcdo],count,sts,NULL);
-     pipel[tcdo][1]++;
+     redisAppendCommandArgv(conns[tcdo].ctx,count,sts,NULL);
+     conns[tcdo].pending++;
      return NULL;
    }
 }
@@ -996,25 +1018,68 @@ char *mem_str(char **p,const char *st,int i) {
   return p[i];
 }
 
-int validate_conn(int conn,char *str,const char *command,int *pconn){
-  int i;
-  if(conn>=INCRPIPE && pipel[conn-INCRPIPE][0]) {
-    conn-=INCRPIPE;
-    *pconn=conn;
-  }
-  for(i=0;i<TOPC;i++) {
-    if(conn==i){
-      break;
+int new_handle(void) {
+  int i,n;
+  struct connection *p;
+  if(free_conns==-1) {
+    n=(nconns==0 ? 16 : 2*nconns);
+    p=(struct connection *)realloc(conns,n*sizeof(struct connection));
+    if(p==NULL) {
+      return -1;
+    }
+    conns=p;
+    for(i=n-1;i>=nconns;i--) {
+      conns[i].used=0;
+      conns[i].next_free=free_conns;
+      free_conns=i;
     }
+    nconns=n;
   }
-  if(i==TOPC) {
+  i=free_conns;
+  free_conns=conns[i].next_free;
+  memset(&conns[i],0,sizeof(struct connection));
+  conns[i].used=1;
+  conns[i].conn=-1;
+  conns[i].pipe=-1;
+  return i;
+}
+
+void free_handle(int i) {
+  free(conns[i].host);
+  conns[i].used=0;
+  conns[i].ctx=(redisContext *)NULL;
+  conns[i].next_free=free_conns;
+  free_conns=i;
+}
+
+void drop_conn(int i) {
+  // the connection, its pipeline and its context go together
+  if(conns[i].pipe!=-1) {
+    free_handle(conns[i].pipe);
+  }
+  if(cur_conn==i) {
+    cur_conn=-1;
+  }
+  redisFree(conns[i].ctx);
+  free_handle(i);
+}
+
+int validate_conn(int conn,char *str,const char *command,int *pconn){
+  cur_conn=-1;
+  if(conn<0 || conn>=nconns) {
    sprintf(str,"%s: connection %d out of range",command,conn);
    return 0;
   } 
-  if(c[conn]==(redisContext *)NULL){
+  if(conns[conn].used && conns[conn].conn!=-1) {
+    conn=conns[conn].conn;
+    *pconn=conn;
+  }
+  if(!conns[conn].used || conns[conn].ctx==(redisContext *)NULL){
    sprintf(str,"%s: connection error for number %d",command,conn);
    return 0;
   }
+  cur_conn=conn;
+  conns[conn].calls++;
   return 1;
 }
 
@@ -1135,6 +1200,59 @@ int theReplyArrayK1(awk_array_t array, redisReply *rep ){
     return 1;
 }
 
+int theReplyTree(awk_array_t array, redisReply *rep) {
+    // any reply, nested to any depth, element j at index j+1;
+    // the strings keep their length, so they may hold anything
+    size_t j;
+    char str[25];
+    awk_value_t tmp,value,ind;
+    redisReply *el;
+    for (j = 0; j < rep->elements; j++) {
+      el=rep->element[j];
+      sprintf(str, "%zu", j+1);
+      switch(el->type) {
+      case REDIS_REPLY_ARRAY:
+#ifdef REDIS_REPLY_MAP
+      case REDIS_REPLY_MAP:
+      case REDIS_REPLY_SET:
+      case REDIS_REPLY_PUSH:
+#endif
+        make_const_string(str,strlen(str), & ind);
+        value.val_type = AWK_ARRAY;
+        value.array_cookie = create_array();
+        if(!set_array_element(array,&ind,&value)) {
+          return 0;
+        }
+        theReplyTree(value.array_cookie,el);
+        break;
+      case REDIS_REPLY_INTEGER:
+#ifdef REDIS_REPLY_BOOL
+      case REDIS_REPLY_BOOL:
+#endif
+        array_set(array,str,make_number(el->integer, & tmp));
+        break;
+      case REDIS_REPLY_NIL:
+        array_set(array,str,make_null_string(& tmp));
+        break;
+      case REDIS_REPLY_STATUS:
+        if(strcmp(el->str,"OK")==0) {
+          array_set(array,str,make_number(1, & tmp));
+          break;
+        }
+        /* FALL THROUGH */
+      default:  // strings, errors, and the other RESP3 scalars
+        if(el->str==NULL) {
+          array_set(array,str,make_null_string(& tmp));
+        }
+        else {
+          array_set(array,str,make_const_user_input(el->str,el->len, & tmp));
+        }
+        break;
+      }
+    }
+    return 1;
+}
+
 int theReplyToArray(awk_array_t array,const char* RS,const char FS){
     char str[240], *pstr, *pch, *psep, *pkey, *pval;
     awk_value_t tmp;
@@ -1290,6 +1408,9 @@ awk_value_t * theReply(awk_value_t *result, redisContext *conn) {
     
     if(conn->err!=0){
       set_ERRNO(_(conn->errstr));
+      if(cur_conn!=-1) {
+        conns[cur_conn].errors++;
+      }
       return make_number(-1, result);
     }
 
@@ -1310,6 +1431,9 @@ awk_value_t * theReply(awk_value_t *result, redisContext *conn) {
     }
     if(reply->type==REDIS_REPLY_ERROR){
       set_ERRNO(_(reply->str));
+      if(cur_conn!=-1) {
+        conns[cur_conn].errors++;
+      }
       pstr=make_number(-1, result);
     }
     if(reply->type==REDIS_REPLY_NIL){
@@ -1348,12 +1472,12 @@ awk_value_t * tipoExec(int nargs,awk_value_t *result,const char *command) {
     get_argument(1, AWK_ARRAY, & array_param);
     array_ou = array_param.array_cookie;
     if(pconn==-1) {
-      reply = redisCommand(c[ival],"%s",command);
-      pstr=processREPLY(array_ou,result,c[ival],"tipoExec");
+      reply = redisCommand(conns[ival].ctx,"%s",command);
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"tipoExec");
     }
     else {
-      redisAppendCommand(c[pconn],"%s",command);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s",command);
+      conns[pconn].pending++;
       return make_number(1, result);
     }
   }
@@ -1422,10 +1546,10 @@ awk_value_t * tipoSlowlog(int nargs,awk_value_t *result,const char *command) {
 
     if(pconn==-1) {
       if(getlen || get) {
-        pstr=processREPLY(array_ou,result,c[ival],"tipoExec");
+        pstr=processREPLY(array_ou,result,conns[ival].ctx,"tipoExec");
       }
       else {
-        pstr=processREPLY(NULL,result,c[ival],NULL);
+        pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
       }
     }
     free_mem_str(sts,cnt+1);
@@ -1476,12 +1600,12 @@ awk_value_t * tipoEvalsha(int nargs,awk_value_t *result,const char *command) {
     mem_str(sts,val1.str_value.str,1);
     mem_str(sts,val2.str_value.str,2);
     if(pconn==-1) {
-      reply = redisCommandArgv(c[ival],count,(const char **)sts,NULL);
-      pstr=processREPLY(array_ou,result,c[ival],"tipoExec");
+      reply = redisCommandArgv(conns[ival].ctx,count,(const char **)sts,NULL);
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"tipoExec");
     }
     else {
-      redisAppendCommandArgv(c[pconn],count,(const char **)sts,NULL);
-      pipel[pconn][1]++;
+      redisAppendCommandArgv(conns[pconn].ctx,count,(const char **)sts,NULL);
+      conns[pconn].pending++;
       return make_number(1, result);
     }
     free_mem_str(sts,count);
@@ -1527,12 +1651,12 @@ awk_value_t * tipoZrangebylex(int nargs,awk_value_t *result,const char *command)
     get_argument(3, AWK_STRING, & val2);
     get_argument(4, AWK_STRING, & val3);
     if(pconn==-1) {
-      reply = redisCommand(c[ival],"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      reply = redisCommand(conns[ival].ctx,"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     else {
-      redisAppendCommand(c[pconn],"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
+      conns[pconn].pending++;
       return make_number(1, result);
     }
   }
@@ -1582,25 +1706,25 @@ awk_value_t * tipoSscan(int nargs,awk_value_t *result,const char *command) {
     if(nargs==5) {
       get_argument(4, AWK_STRING, & val3);
       if(pconn==-1) {
-        reply = redisCommand(c[ival],"%s %s %d MATCH %s",command,val1.str_value.str,ival2,val3.str_value.str);
+        reply = redisCommand(conns[ival].ctx,"%s %s %d MATCH %s",command,val1.str_value.str,ival2,val3.str_value.str);
       }
       else {
-        redisAppendCommand(c[pconn],"%s %s %d MATCH %s",command,val1.str_value.str,ival2,val3.str_value.str);
-        pipel[pconn][1]++;
+        redisAppendCommand(conns[pconn].ctx,"%s %s %d MATCH %s",command,val1.str_value.str,ival2,val3.str_value.str);
+        conns[pconn].pending++;
         return make_number(1, result);
       }
     }
     else {
       if(pconn==-1) {
-        reply = redisCommand(c[ival],"%s %s %d",command,val1.str_value.str,ival2);
+        reply = redisCommand(conns[ival].ctx,"%s %s %d",command,val1.str_value.str,ival2);
       }
       else {
-        redisAppendCommand(c[pconn],"%s %s %d",command,val1.str_value.str,ival2);
-        pipel[pconn][1]++;
+        redisAppendCommand(conns[pconn].ctx,"%s %s %d",command,val1.str_value.str,ival2);
+        conns[pconn].pending++;
         return make_number(1, result);
       }
     }
-    pstr=processREPLY(array,result,c[ival],"tipoScan");
+    pstr=processREPLY(array,result,conns[ival].ctx,"tipoScan");
   }
   else {
     sprintf(str,"%s needs three or four arguments",command);
@@ -1652,7 +1776,7 @@ awk_value_t * tipoScan(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"tipoScan");
+      pstr=processREPLY(array,result,conns[ival].ctx,"tipoScan");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -1731,13 +1855,18 @@ awk_value_t * tipoPipeline(int nargs,awk_value_t *result,const char *command) {
       return make_number(-1, result);
     }
 
-    if(pipel[ival][0]) {
+    if(pconn!=-1 || conns[ival].pipe!=-1) {
       sprintf(str,"%s: exists already a pipe for this connection", command);
       set_ERRNO(_(str));
       return make_number(-1, result);
     }
-    pipel[ival][0]=1;
-    ret=ival+INCRPIPE;
+    if((ret=new_handle())==-1) {
+      sprintf(str,"%s: out of memory", command);
+      set_ERRNO(_(str));
+      return make_number(-1, result);
+    }
+    conns[ret].conn=ival;
+    conns[ival].pipe=ret;
   }
   else {
     sprintf(str,"%s needs one argument",command);
@@ -1747,6 +1876,185 @@ awk_value_t * tipoPipeline(int nargs,awk_value_t *result,const char *command) {
   return make_number(ret, result);
 }
 
+static awk_value_t * do_command(int nargs, awk_value_t *result API_FINFO_ARG) {
+   awk_value_t *p_value_t;
+#if gawk_api_major_version < 2
+    if (do_lint && (nargs > 3)) {
+      lintwarn(ext_id, _("redis_command: called with too many arguments"));
+    }
+#endif
+   p_value_t=tipoCommand(nargs,result,"command");
+   return p_value_t;
+}
+
+awk_value_t * tipoCommand(int nargs,awk_value_t *result,const char *command) {
+  int r,ival,pconn=-1;
+  struct command valid;
+  char str[240];
+  awk_value_t val, idx, array_param, *pstr=NULL;
+  awk_array_t array_in, array_ou=NULL;
+  enum format_type there[3];
+  size_t i, count;
+  const char **argv;
+  size_t *argvlen;
+  redisContext *ctx;
+
+  if(nargs==2 || nargs==3) {
+    strcpy(valid.name,command);
+    valid.num=nargs;
+    valid.type[0]=CONN;
+    valid.type[1]=ARRAY;
+    valid.type[2]=ARRAY;
+    if(!validate(valid,str,&r,there)) {
+      set_ERRNO(_(str));
+      return make_number(-1, result);
+    }
+    get_argument(0, AWK_NUMBER, & val);
+    ival=val.num_value;
+    if(!validate_conn(ival,str,command,&pconn)) {
+      set_ERRNO(_(str));
+      return make_number(-1, result);
+    }
+    get_argument(1, AWK_ARRAY, & array_param);
+    array_in = array_param.array_cookie;
+    if(nargs==3) {
+      get_argument(2, AWK_ARRAY, & array_param);
+      array_ou = array_param.array_cookie;
+      clear_array(array_ou);
+    }
+    get_element_count(array_in, &count);
+    if(count==0) {
+      sprintf(str,"%s: the array of arguments is empty",command);
+      set_ERRNO(_(str));
+      return make_number(-1, result);
+    }
+    // the arguments are passed to hiredis with their length, and
+    // it copies them before anything can change the array
+    argv=(const char **)malloc(count*sizeof(char *));
+    argvlen=(size_t *)malloc(count*sizeof(size_t));
+    for(i=0;i<count;i++) {
+      if(!get_array_element(array_in,make_number(i+1,&idx),AWK_STRING,&val)) {
+        sprintf(str,"%s: the array of arguments has no element %zu",command,i+1);
+        set_ERRNO(_(str));
+        free(argv);
+        free(argvlen);
+        return make_number(-1, result);
+      }
+      argv[i]=val.str_value.str;
+      argvlen[i]=val.str_value.len;
+    }
+    if(pconn!=-1) {
+      ctx=conns[pconn].ctx;
+      if(redisAppendCommandArgv(ctx,(int)count,argv,argvlen)==REDIS_OK) {
+        conns[pconn].pending++;
+        pstr=make_number(1,result);
+      }
+    }
+    else {
+      ctx=conns[ival].ctx;
+      reply=redisCommandArgv(ctx,(int)count,argv,argvlen);
+    }
+    free(argv);
+    free(argvlen);
+    if(pconn!=-1) {
+      if(pstr==NULL) {
+        set_ERRNO(_(ctx->errstr));
+        pstr=make_number(-1,result);
+      }
+      return pstr;
+    }
+    if(reply==NULL) {
+      set_ERRNO(_(ctx->errstr));
+      conns[cur_conn].errors++;
+      return make_number(-1, result);
+    }
+    if(reply->type==REDIS_REPLY_ARRAY
+#ifdef REDIS_REPLY_MAP
+       || reply->type==REDIS_REPLY_MAP || reply->type==REDIS_REPLY_SET
+#endif
+      ) {
+      if(array_ou==NULL) {
+        sprintf(str,"%s: %s",command,"needs an array as third argument, the reply is an array");
+        set_ERRNO(_(str));
+        pstr=make_number(-1, result);
+      }
+      else {
+        pstr=make_number(theReplyTree(array_ou,reply) && reply->elements > 0, result);
+      }
+    }
+    else {
+      pstr=theReply(result,ctx);
+      if(pstr==NULL) {  // the other RESP3 scalars
+        pstr=(reply->str==NULL ? make_null_string(result)
+              : make_user_input_malloc(reply->str,reply->len,result));
+      }
+    }
+    freeReplyObject(reply);
+  }
+  else {
+    sprintf(str,"%s needs two or three arguments",command);
+    set_ERRNO(_(str));
+    return make_number(-1, result);
+  }
+  return pstr;
+}
+
+static awk_value_t * do_stats(int nargs __UNUSED_V2, awk_value_t *result API_FINFO_ARG) {
+   awk_value_t *p_value_t;
+#if gawk_api_major_version < 2
+    if (do_lint && (nargs > 2)) {
+      lintwarn(ext_id, _("redis_stats: called with too many arguments"));
+    }
+#endif
+   p_value_t=tipoStats(nargs,result,"stats");
+   return p_value_t;
+}
+
+awk_value_t * tipoStats(int nargs,awk_value_t *result,const char *command) {
+  int r,ival;
+  struct command valid;
+  char str[240];
+  awk_value_t val, array_param, tmp;
+  awk_array_t array;
+  enum format_type there[2];
+  int pconn=-1;
+  struct connection *p;
+
+  if(nargs==2) {
+    strcpy(valid.name,command);
+    valid.num=2;
+    valid.type[0]=CONN;
+    valid.type[1]=ARRAY;
+    if(!validate(valid,str,&r,there)) {
+      set_ERRNO(_(str));
+      return make_number(-1, result);
+    }
+    get_argument(0, AWK_NUMBER, & val);
+    ival=val.num_value;
+    if(!validate_conn(ival,str,command,&pconn)) {
+      set_ERRNO(_(str));
+      return make_number(-1, result);
+    }
+    p=&conns[cur_conn];
+    p->calls--;  // asking does not count
+    get_argument(1, AWK_ARRAY, & array_param);
+    array = array_param.array_cookie;
+    clear_array(array);
+    array_set(array,"host",make_const_string(p->host,strlen(p->host), & tmp));
+    array_set(array,"port",make_number(p->port, & tmp));
+    array_set(array,"calls",make_number(p->calls, & tmp));
+    array_set(array,"errors",make_number(p->errors, & tmp));
+    array_set(array,"pending",make_number(p->pending, & tmp));
+    array_set(array,"pipeline",make_number(p->pipe, & tmp));
+  }
+  else {
+    sprintf(str,"%s needs two arguments",command);
+    set_ERRNO(_(str));
+    return make_number(-1, result);
+  }
+  return make_number(1, result);
+}
+
 awk_value_t * tipoSelect(int nargs,awk_value_t *result,const char *command) {
   int r,ival,ival1;
   struct command valid;
@@ -1773,12 +2081,12 @@ awk_value_t * tipoSelect(int nargs,awk_value_t *result,const char *command) {
     get_argument(1, AWK_NUMBER, & val1);
     ival1=val1.num_value;
     if(pconn==-1) {
-      reply = redisCommand(c[ival],"%s %d",command,ival1);
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      reply = redisCommand(conns[ival].ctx,"%s %d",command,ival1);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     else {
-      redisAppendCommand(c[pconn],"%s %d",command,ival1);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %d",command,ival1);
+      conns[pconn].pending++;
       pstr=make_number(1,result);
     }
   }
@@ -1827,7 +2135,7 @@ awk_value_t * tipoRandomkey(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -1870,7 +2178,7 @@ awk_value_t * tipoClientOne(int nargs,awk_value_t *result,const char *command) {
    mem_cdo(sts,the_command,++cnt);
    reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
    if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
    }
    free_mem_str(sts,cnt+1);
   }
@@ -1948,10 +2256,10 @@ awk_value_t * tipoClientTwo(int nargs,awk_value_t *result,const char *command) {
    reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
    if(pconn==-1) {
       if(strcmp(the_command,"list") == 0) {
-        pstr=processREPLY(array,result,c[ival],"tipoClient");
+        pstr=processREPLY(array,result,conns[ival].ctx,"tipoClient");
       }
       else {
-          pstr=processREPLY(NULL,result,c[ival],NULL);
+          pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
       }
    }
    free_mem_str(sts,cnt+1);
@@ -1966,12 +2274,12 @@ awk_value_t * tipoClientTwo(int nargs,awk_value_t *result,const char *command) {
 
 awk_value_t * tipoConnect(int nargs,awk_value_t *result,const char *command) {
   int ret,r,port=6379;
-  size_t i;
   struct command valid;
   char str[240];
   awk_value_t val, val1;
   enum format_type there[2];
-  char address[16]="127.0.0.1";
+  const char *address="127.0.0.1";
+  redisContext *ctx;
   if(nargs==0||nargs==1||nargs==2) {
     strcpy(valid.name,command); 
     if(nargs==1){
@@ -1991,32 +2299,32 @@ awk_value_t * tipoConnect(int nargs,awk_value_t *result,const char *command) {
     }
     if(nargs>=1) {
      get_argument(0, AWK_STRING, & val);
-     strcpy(address,val.str_value.str);
+     address=val.str_value.str;
     }
     if(nargs==2) {
      get_argument(1, AWK_NUMBER, & val1);
      port=val1.num_value;
     }
-    for(i=0;i<TOPC;i++) {
-      if(!c[i]) {
-        break;
-      }
-    }
-    if(i==TOPC) {
-     set_ERRNO(_("connection: not possible, exceeds the connection limit"));
-     ret=-1;
-     return make_number(ret, result);
-    }
-    c[i] = redisConnect((const char*)address, port);
-    if (c[i]->err) {
-      sprintf(str,"connection error: %s\n", c[i]->errstr);
+    ctx = redisConnect(address, port);
+    if (ctx==NULL || ctx->err) {
+      sprintf(str,"connection error: %s\n", ctx ? ctx->errstr : "out of memory");
       set_ERRNO(_(str));
-      c[i]=(redisContext *)NULL;
-      ret=-1;
+      redisFree(ctx);
+      return make_number(-1, result);
     }
-    else {
-      ret=i;
+    if((ret=new_handle())==-1) {
+      set_ERRNO(_("connection: not possible, out of memory"));
+      redisFree(ctx);
+      return make_number(-1, result);
+    }
+    if((conns[ret].host=strdup(address))==NULL) {
+      set_ERRNO(_("connection: not possible, out of memory"));
+      redisFree(ctx);
+      free_handle(ret);
+      return make_number(-1, result);
     }
+    conns[ret].ctx=ctx;
+    conns[ret].port=port;
     return make_number(ret, result);
   }
   else {
@@ -2127,7 +2435,7 @@ awk_value_t * tipoScript(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-       pstr=processREPLY(array_ou,result,c[ival],"theRest");
+       pstr=processREPLY(array_ou,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2169,7 +2477,7 @@ awk_value_t * tipoScard(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2276,13 +2584,13 @@ awk_value_t * tipoPubsub(int nargs,awk_value_t *result,const char *command) {
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
       if(channels) {
-        pstr=processREPLY(array,result,c[ival],"theRest");
+        pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
       }
       if(numsub) {
-        pstr=processREPLY(array,result,c[ival],"theRest1");
+        pstr=processREPLY(array,result,conns[ival].ctx,"theRest1");
       }
       if(numpat) {
-        pstr=processREPLY(NULL,result,c[ival],NULL);
+        pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
       }
     }
     free_mem_str(sts,cnt+1);
@@ -2338,10 +2646,10 @@ awk_value_t * tipoSpop(int nargs,awk_value_t *result,const char *command) {
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
       if(withcount) {
-        pstr=processREPLY(array,result,c[ival],"theRest");
+        pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
       }
       else {
-        pstr=processREPLY(NULL,result,c[ival],NULL);
+        pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
       }
     }
     free_mem_str(sts,cnt+1);
@@ -2399,7 +2707,7 @@ awk_value_t * tipoBrpop(int nargs,awk_value_t *result,const char *command) {
     array_ou = array_param.array_cookie;
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array_ou,result,c[ival],"theRest");
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2443,7 +2751,7 @@ awk_value_t * tipoSinter(int nargs,awk_value_t *result,const char *command) {
     array_ou = array_param.array_cookie;
     reply = (redisReply *)rCommand(pconn,ival,count,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array_ou,result,c[ival],"theRest");
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,count);
   }
@@ -2554,7 +2862,7 @@ awk_value_t * tipoSubscribe(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-        pstr=processREPLY(NULL,result,c[ival],NULL);
+        pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2611,7 +2919,7 @@ awk_value_t * tipoSadd(int nargs,awk_value_t *result,const char *command) {
     }  
     reply = (redisReply *)rCommand(pconn,ival,count,(const char **)sts);
     if(pconn==-1) {
-        pstr=processREPLY(NULL,result,c[ival],NULL);
+        pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,count);
   }
@@ -2659,7 +2967,7 @@ awk_value_t * tipoGetrange(int nargs,awk_value_t *result,const char *command) {
      mem_cdo(sts,val3.str_value.str,++cnt);
      reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
      if(pconn==-1) {
-       pstr=processREPLY(NULL,result,c[ival],NULL);
+       pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
      }
      free_mem_str(sts,cnt+1);
   }
@@ -2719,7 +3027,7 @@ awk_value_t * tipoZadd(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val3.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-       pstr=processREPLY(NULL,result,c[ival],NULL);
+       pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2730,7 +3038,7 @@ awk_value_t * tipoZadd(int nargs,awk_value_t *result,const char *command) {
     mem_str(sts,val1.str_value.str,1);
     reply = (redisReply *)rCommand(pconn,ival,count,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,count);
   }
@@ -2772,7 +3080,7 @@ awk_value_t * tipoSetrange(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val3.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2824,7 +3132,7 @@ awk_value_t * tipoBitcount(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2887,7 +3195,7 @@ awk_value_t * tipoBitpos(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -2942,7 +3250,7 @@ awk_value_t * tipoGeodist(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3034,7 +3342,7 @@ awk_value_t * tipoGeoradius(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3121,7 +3429,7 @@ awk_value_t * tipoGeoradiusbymember(int nargs,awk_value_t *result,const char *co
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3263,7 +3571,7 @@ awk_value_t * tipoGeoradiusWD(int nargs,awk_value_t *result,const char *command)
       }
       reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
       if(pconn==-1) {
-        pstr=processREPLY(array,result,c[ival],"tipoExec");
+        pstr=processREPLY(array,result,conns[ival].ctx,"tipoExec");
       }
       free_mem_str(sts,cnt+1);
   }
@@ -3402,7 +3710,7 @@ awk_value_t * tipoGeoradiusbymemberWD(int nargs,awk_value_t *result,const char *
    }
    reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
    if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"tipoExec");
+      pstr=processREPLY(array,result,conns[ival].ctx,"tipoExec");
    }
    free_mem_str(sts,cnt+1);
   }
@@ -3442,13 +3750,13 @@ awk_value_t * tipoSetbit(int nargs,awk_value_t *result,const char *command) {
     get_argument(2, AWK_STRING, & val2);
     get_argument(3, AWK_STRING, & val3);
     if(pconn==-1) {
-      reply = redisCommand(c[ival],"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
-      pstr=theReply(result,c[ival]);
+      reply = redisCommand(conns[ival].ctx,"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
+      pstr=theReply(result,conns[ival].ctx);
       freeReplyObject(reply);
     }
     else {
-      redisAppendCommand(c[pconn],"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %s %s %s",command,val1.str_value.str,val2.str_value.str,val3.str_value.str);
+      conns[pconn].pending++;
       pstr=make_number(1,result);
     }
   }
@@ -3533,7 +3841,7 @@ awk_value_t * tipoBitop(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3585,7 +3893,7 @@ awk_value_t * tipoLinsert(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val3.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3633,7 +3941,7 @@ awk_value_t * tipoSmove(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val3.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3681,7 +3989,7 @@ awk_value_t * tipoZincrby(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val3.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3728,7 +4036,7 @@ awk_value_t * tipoHincrby(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val3.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3768,13 +4076,13 @@ awk_value_t * tipoRestore(int nargs,awk_value_t *result,const char *command) {
     get_argument(2, AWK_STRING, & val2);
     get_argument(3, AWK_STRING, & val3);
     if(pconn==-1) {
-      reply = redisCommand(c[ival],"%s %s %s %b",command,val1.str_value.str,val2.str_value.str,val3.str_value.str,val3.str_value.len);
-      pstr=theReply(result,c[ival]);
+      reply = redisCommand(conns[ival].ctx,"%s %s %s %b",command,val1.str_value.str,val2.str_value.str,val3.str_value.str,val3.str_value.len);
+      pstr=theReply(result,conns[ival].ctx);
       freeReplyObject(reply);
     }
     else {
-      redisAppendCommand(c[pconn],"%s %s %s %b",command,val1.str_value.str,val2.str_value.str,val3.str_value.str,val3.str_value.len);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %s %s %b",command,val1.str_value.str,val2.str_value.str,val3.str_value.str,val3.str_value.len);
+      conns[pconn].pending++;
       pstr=make_number(1,result);
     }
   }
@@ -3813,13 +4121,13 @@ awk_value_t * tipoExpire(int nargs,awk_value_t *result,const char *command) {
     get_argument(1, AWK_STRING, & val1);
     get_argument(2, AWK_STRING, & val2);
     if(pconn==-1){ 
-      reply = redisCommand(c[ival],"%s %s %s",command,val1.str_value.str,val2.str_value.str);
-      pstr=theReply(result,c[ival]);
+      reply = redisCommand(conns[ival].ctx,"%s %s %s",command,val1.str_value.str,val2.str_value.str);
+      pstr=theReply(result,conns[ival].ctx);
       freeReplyObject(reply);
     }
     else {
-      redisAppendCommand(c[pconn],"%s %s %s",command,val1.str_value.str,val2.str_value.str);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %s %s",command,val1.str_value.str,val2.str_value.str);
+      conns[pconn].pending++;
       pstr=make_number(1,result);
     }
   }
@@ -3871,7 +4179,7 @@ awk_value_t * tipoSet(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3926,7 +4234,7 @@ awk_value_t * tipoSismember(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,mbr.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -3982,7 +4290,7 @@ awk_value_t * tipoObject(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,mbr.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,cnt+1);
   }
@@ -4027,23 +4335,32 @@ awk_value_t * tipoGetReply(int nargs,awk_value_t *result,const char *command) {
        get_argument(1, AWK_ARRAY, & array_param);
        array = array_param.array_cookie;
      }
-     if(pconn==-1 || pipel[pconn][1]<=0) {
+     if(pconn==-1 || conns[pconn].pending<=0) {
        sprintf(str,"%s: No such reply, nothing to getReply\n",command);
        set_ERRNO(_(str));
        return make_number(-1, result);
      }
-     if((ret=redisGetReply(c[pconn],(void **)&reply))==REDIS_OK) {
-       pipel[pconn][1]--;
+     if((ret=redisGetReply(conns[pconn].ctx,(void **)&reply))==REDIS_OK) {
+       conns[pconn].pending--;
        if(nargs==2) {
         if(strcmp(command,"getReplyInfo")==0){
-          pstr=processREPLY(array,result,c[pconn],"tipoInfo");
+          pstr=processREPLY(array,result,conns[pconn].ctx,"tipoInfo");
+        }
+        else if(reply->type==REDIS_REPLY_ARRAY
+#ifdef REDIS_REPLY_MAP
+                || reply->type==REDIS_REPLY_MAP || reply->type==REDIS_REPLY_SET
+#endif
+               ) {
+          // as redis_command() without a pipeline: nils and statuses kept
+          pstr=make_number(theReplyTree(array,reply) && reply->elements > 0, result);
+          freeReplyObject(reply);
         }
         else {
-          pstr=processREPLY(array,result,c[pconn],"tipoExec");
+          pstr=processREPLY(array,result,conns[pconn].ctx,"tipoExec");
         }
        }
        else {
-         pstr=processREPLY(NULL,result,c[pconn],NULL);
+         pstr=processREPLY(NULL,result,conns[pconn].ctx,NULL);
          if(!pstr) {
            sprintf(str,"%s (%s)","getReply function needs an array as an argument", "the function pipelined returns an array");
            set_ERRNO(_(str));
@@ -4052,10 +4369,10 @@ awk_value_t * tipoGetReply(int nargs,awk_value_t *result,const char *command) {
        }
      }
      if(ret==REDIS_ERR) {
-       if(c[pconn]->err) {
-           sprintf(str,"%s: error %s\n",command,c[pconn]->errstr);
+       if(conns[pconn].ctx->err) {
+           sprintf(str,"%s: error %s\n",command,conns[pconn].ctx->errstr);
 	   set_ERRNO(_(str));
-	   c[pconn]=(redisContext *)NULL;
+	   drop_conn(pconn);
            return make_number(-1, result);
        }
      }
@@ -4090,21 +4407,21 @@ awk_value_t * tipoGetReplyMass(int nargs,awk_value_t *result,const char *command
       set_ERRNO(_(str));
       return make_number(-1, result);
     }
-    if(pconn==-1 || pipel[pconn][1]<=0) {
+    if(pconn==-1 || conns[pconn].pending<=0) {
       sprintf(str,"%s: No such reply, nothing to getReplyMassive\n",command);
       set_ERRNO(_(str));
       return make_number(-1, result);
     }
-    replies=pipel[pconn][1];
-    while(pipel[pconn][1] > 0 && (ret=redisGetReply(c[pconn],(void **)&reply)) == REDIS_OK) {
+    replies=conns[pconn].pending;
+    while(conns[pconn].pending > 0 && (ret=redisGetReply(conns[pconn].ctx,(void **)&reply)) == REDIS_OK) {
       freeReplyObject(reply);
-      pipel[pconn][1]--;
+      conns[pconn].pending--;
     }
     if(ret==REDIS_ERR) {
-      if(c[pconn]->err) {
-        sprintf(str,"%s: error %s\n",command,c[pconn]->errstr);
+      if(conns[pconn].ctx->err) {
+        sprintf(str,"%s: error %s\n",command,conns[pconn].ctx->errstr);
 	set_ERRNO(_(str));
-	c[pconn]=(redisContext *)NULL;
+	drop_conn(pconn);
         return make_number(-1, result);
       }
     }
@@ -4114,7 +4431,7 @@ awk_value_t * tipoGetReplyMass(int nargs,awk_value_t *result,const char *command
     set_ERRNO(_(str));
     return make_number(-1, result);
   }
-  return make_number(replies - pipel[pconn][1],result);
+  return make_number(replies - conns[pconn].pending,result);
 }
 
 awk_value_t * tipoGetMessage(int nargs,awk_value_t *result,const char *command) {
@@ -4143,21 +4460,21 @@ awk_value_t * tipoGetMessage(int nargs,awk_value_t *result,const char *command)
     get_argument(1, AWK_ARRAY, & array_param);
     array = array_param.array_cookie;
     if(pconn==-1) {
-     if((ret=redisGetReply(c[ival],(void **)&reply)) == REDIS_OK) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+     if((ret=redisGetReply(conns[ival].ctx,(void **)&reply)) == REDIS_OK) {
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
      }
      if(ret==REDIS_ERR) {
-       if(c[ival]->err) {
-         sprintf(str,"%s: error %s\n",command,c[ival]->errstr);
+       if(conns[ival].ctx->err) {
+         sprintf(str,"%s: error %s\n",command,conns[ival].ctx->errstr);
          set_ERRNO(_(str));
-         c[ival]=(redisContext *)NULL;
+         drop_conn(ival);
          return make_number(-1, result);
        }
      }
     }
     else {
-      redisAppendCommand(c[pconn],"%s %s",command,val.str_value.str);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %s",command,val.str_value.str);
+      conns[pconn].pending++;
     }
   }
   else {
@@ -4223,7 +4540,7 @@ awk_value_t * tipoZrange(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -4311,7 +4628,7 @@ awk_value_t * tipoZunionstore(int nargs,awk_value_t *result,const char *command)
     mem_str(sts,st_nkeys,2); // passing a string nkeys
     reply = (redisReply *)rCommand(pconn,ival,count,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(NULL,result,c[ival],NULL);
+      pstr=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,count);
   }
@@ -4398,7 +4715,7 @@ awk_value_t * tipoSortLimit(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -4477,7 +4794,7 @@ awk_value_t * tipoSort(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -4533,7 +4850,7 @@ awk_value_t * tipoKeys(int nargs,awk_value_t *result,const char *command) {
     mem_cdo(sts,val.str_value.str,++cnt);
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
    }
@@ -4581,7 +4898,7 @@ awk_value_t * tipoGeohash(int nargs,awk_value_t *result,const char *command) {
     mem_str(sts,val.str_value.str,1);
     reply = (redisReply *)rCommand(pconn,ival,count,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,count);
    }
@@ -4631,7 +4948,7 @@ awk_value_t * tipoInfo(int nargs,awk_value_t *result,const char *command) {
      }
      reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
      if(pconn==-1) {
-       pstr=processREPLY(array,result,c[ival],"tipoInfo");
+       pstr=processREPLY(array,result,conns[ival].ctx,"tipoInfo");
      }
      free_mem_str(sts,cnt+1);
    }
@@ -4674,12 +4991,12 @@ awk_value_t * tipoSrandmember(int nargs,awk_value_t *result,const char *command)
     get_argument(3, AWK_ARRAY, & array_param);
     array = array_param.array_cookie;
     if(pconn==-1) {
-      reply = redisCommand(c[ival],"%s %s %s",command,val.str_value.str,val1.str_value.str);
-      pstr=processREPLY(array,result,c[ival],"theRest");
+      reply = redisCommand(conns[ival].ctx,"%s %s %s",command,val.str_value.str,val1.str_value.str);
+      pstr=processREPLY(array,result,conns[ival].ctx,"theRest");
     }
     else {
-      redisAppendCommand(c[pconn],"%s %s %s",command,val.str_value.str,val1.str_value.str);
-      pipel[pconn][1]++;
+      redisAppendCommand(conns[pconn].ctx,"%s %s %s",command,val.str_value.str,val1.str_value.str);
+      conns[pconn].pending++;
     }
   }
   else {
@@ -4809,7 +5126,7 @@ awk_value_t * tipoMset(int nargs,awk_value_t *result,const char *command) {
     sts=getArrayContent(array,1,command,&count);
     reply = (redisReply *)rCommand(pconn,ival,count,(const char **)sts);
     if(pconn==-1) {
-      pts=processREPLY(NULL,result,c[ival],NULL);
+      pts=processREPLY(NULL,result,conns[ival].ctx,NULL);
     }
     free_mem_str(sts,count);
   }
@@ -4852,13 +5169,13 @@ awk_value_t * tipoHmset(int nargs,awk_value_t *result,const char *command) {
     sts=getArrayContent(array,2,"HMSET",&count);
     mem_str(sts,val.str_value.str,1);
     if(pconn==-1) {
-      reply = redisCommandArgv(c[ival],count,(const char **)sts,NULL);
-      pts=theReply(result,c[ival]);
+      reply = redisCommandArgv(conns[ival].ctx,count,(const char **)sts,NULL);
+      pts=theReply(result,conns[ival].ctx);
       freeReplyObject(reply);
     }
     else {
-      redisAppendCommandArgv(c[pconn],count,(const char **)sts,NULL);
-      pipel[pconn][1]++;
+      redisAppendCommandArgv(conns[pconn].ctx,count,(const char **)sts,NULL);
+      conns[pconn].pending++;
       pts=make_number(1, result);
     }
     free(sts);
@@ -4903,11 +5220,11 @@ awk_value_t * tipoHmget(int nargs,awk_value_t *result,const char *command) {
     if(there[2]==STRING) {
       get_argument(2, AWK_STRING, & val1);
       if(pconn==-1) {
-       reply = redisCommand(c[ival],"%s %s %s",command,val.str_value.str,val1.str_value.str);
+       reply = redisCommand(conns[ival].ctx,"%s %s %s",command,val.str_value.str,val1.str_value.str);
       }
       else {
-       redisAppendCommand(c[pconn],"%s %s %s",command,val.str_value.str,val1.str_value.str);
-       pipel[pconn][1]++;
+       redisAppendCommand(conns[pconn].ctx,"%s %s %s",command,val.str_value.str,val1.str_value.str);
+       conns[pconn].pending++;
        return make_number(1, result);
       }
     }
@@ -4917,20 +5234,20 @@ awk_value_t * tipoHmget(int nargs,awk_value_t *result,const char *command) {
       sts=getArrayContent(array_in,2,command,&count);
       mem_str(sts,val.str_value.str,1);
       if(pconn==-1) {
-        reply = redisCommandArgv(c[ival],count,(const char **)sts,NULL);
+        reply = redisCommandArgv(conns[ival].ctx,count,(const char **)sts,NULL);
       }
       else {
-        redisAppendCommandArgv(c[pconn],count,(const char **)sts,NULL);
-        pipel[pconn][1]++;
+        redisAppendCommandArgv(conns[pconn].ctx,count,(const char **)sts,NULL);
+        conns[pconn].pending++;
         return make_number(1, result);
       }
       free(sts);
     }
     if(strcmp(command,"geopos")==0) {
-      pstr=processREPLY(array_ou,result,c[ival],"tipoExec");
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"tipoExec");
     }
     else {
-      pstr=processREPLY(array_ou,result,c[ival],"theRest");
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"theRest");
     }
   }
   else {
@@ -4982,7 +5299,7 @@ awk_value_t * tipoMget(int nargs,awk_value_t *result,const char *command) {
     }
     reply = (redisReply *)rCommand(pconn,ival,cnt+1,(const char **)sts);
     if(pconn==-1) {
-      pstr=processREPLY(array_ou,result,c[ival],"theRest");
+      pstr=processREPLY(array_ou,result,conns[ival].ctx,"theRest");
     }
     free_mem_str(sts,cnt+1);
   }
@@ -6095,6 +6412,8 @@ static awk_ext_func_t func_table[] = {
 	API_FUNC("redis_rpop", do_rpop, 2 )
 	API_FUNC("redis_rpoplpush",do_rpoplpush, 3 )
 	API_FUNC("redis_pipeline",do_pipeline, 1 )
+	API_FUNC_MAXMIN("redis_command", do_command, 3, 2 )
+	API_FUNC("redis_stats", do_stats, 2 )
 	API_FUNC_MAXMIN("redis_getReply", do_getReply, 2, 1 )
 	API_FUNC("redis_getReplyInfo", do_getReplyInfo, 2 )
 	API_FUNC("redis_getReplyMass", do_getReplyMass, 1 )
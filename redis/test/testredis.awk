@@ -484,6 +484,47 @@ BEGIN {
   print ret=redis_pubsub(c,"numpaty",A)     # -1
   print ret=redis_pubsub(c,"numpat")     # 0
   print ret=redis_pubsub(c,"numpat","hola")     # -1
+  delete CMD
+  CMD[1]="SET"; CMD[2]="key with spaces"; CMD[3]="a b\0c"
+  print redis_command(c,CMD)  # 1
+  CMD[1]="STRLEN"; delete CMD[3]
+  print redis_command(c,CMD)  # 5
+  CMD[1]="GET"
+  print (redis_command(c,CMD) == "a b\0c")  # 1
+  delete CMD
+  CMD[1]="RPUSH"; CMD[2]="cmdlist"; CMD[3]="x"; CMD[4]="y"
+  print redis_command(c,CMD)  # 2
+  CMD[1]="LRANGE"; CMD[3]=0; CMD[4]=-1
+  delete R
+  print redis_command(c,CMD,R)  # 1
+  print R[1] R[2]
+  delete CMD
+  CMD[1]="EVAL"; CMD[2]="return {1,{'a','b'}}"; CMD[3]=0
+  print redis_command(c,CMD,R)  # 1
+  print R[1], R[2][1], R[2][2]
+  delete CMD
+  CMD[1]="INCRBY"; CMD[2]="cmdcount"; CMD[3]=5
+  print redis_command(p,CMD)  # 1, we have a pipe
+  print redis_command(p,CMD)  # 1
+  print redis_getReply(p)  # 5
+  print redis_getReply(p)  # 10
+  delete CMD
+  CMD[1]="MGET"; CMD[2]="cmdcount"; CMD[3]="nokey"; CMD[4]="cmdcount"
+  delete R
+  print redis_command(c,CMD,R)  # 1
+  print length(R), R[1], (2 in R) && R[2] == "", R[3]
+  print redis_command(p,CMD)  # 1
+  delete R
+  print redis_getReply(p,R)  # 1, the same array as without the pipeline
+  print length(R), R[1], (2 in R) && R[2] == "", R[3]
+  delete CMD
+  CMD[1]="DEL"; CMD[2]="key with spaces"; CMD[3]="cmdlist"; CMD[4]="cmdcount"
+  print redis_command(c,CMD)  # 3
+  delete ST
+  print redis_stats(c,ST)  # 1
+  print ST["host"], ST["port"], ST["pipeline"]==p, ST["pending"]
+  print redis_stats(p,ST)  # 1, the same connection
+  print ST["calls"] > 0
   print redis_subscribe(c,"ib",RET)  # returns 1
   print RET[1]
   print redis_unsubscribe(c,"ib")